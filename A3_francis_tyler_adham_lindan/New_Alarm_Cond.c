@@ -17,6 +17,18 @@
 #include <time.h>
 #include "errors.h"
 #include <semaphore.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <sched.h>
+#include "due_scan.h"
+#include "alarm_clock.h"
+#include "hazard.h"
+#include "alarm_io.h"
+#include "cmd_ring.h"
+#include "alarm_event.h"
+#include "fmt.h"
+#include "replica.h"
+#include "cmd_parse.h"
 
 /*
 * The "alarm" structure now contains the time_t (time since the
@@ -24,24 +36,80 @@
 * sorted. Storing the requested number of seconds would not be
 * enough, since the "alarm thread" cannot tell how long it has
 * been on the list.
+*
+* An alarm whose type has no display thread is dormant: nothing can print
+* it, so it has no deadline ("first" is 1, "time" is not set) and is in no
+* display set. It gets its deadline when a display thread takes it, see
+* set_add(). The message is stored at the end of the node with only the
+* bytes it needs, see alarm_bytes().
 */
 typedef struct alarm_tag {
   struct alarm_tag    *link;
   int                 seconds;
   time_t              time;   /* seconds from EPOCH */
-  char                message[128];
 
   /******* new additions to the alarm_tag structure ********/
   int               type; //identifies the message type ( type >= 1 )
   int               prev_type; // previous message type
-  int               is_new; // 1 == "new" and 0 == "old/not new"
   int               number; /* Message Number */
-  int               request_type; // TypeA == 1 TypeB == 2 TypeC == 3
-  int               expo; // signifies that the type change was confirmed
-  int               first;
+  int               first; // 1 while dormant, until a display thread takes it
+  int               slot; // index in its type's display set, -1 if not in one
+  unsigned long     serial; // unique per node, a replacement gets a new one
+  struct alarm_tag  *type_link, *type_prev; // chain of its type, see type_count_t
   /*******************end new additions***************/
+  char              message[]; // NUL terminated, at most MESSAGE_SIZE bytes
 } alarm_t;
 
+/*
+* bytes of an alarm node holding the message "text"
+*/
+#define alarm_bytes(text) (offsetof(alarm_t, message) + strlen(text) + 1)
+
+#define TYPE_A 1 // Constants to specify alarm request type
+#define TYPE_B 2
+#define TYPE_C 3
+
+/*
+* Header of every request handed from main to the alarm thread. The alarm
+* thread calls request_handlers[request_type] on it, so each request type has
+* its own node layout and handler and nothing branches on the type per node.
+*/
+typedef struct request_tag {
+  struct request_tag  *next; // next request in the dispatch queue
+  int                 request_type; // TypeA == 1 TypeB == 2 TypeC == 3
+  struct namespace_tag *ns; // namespace the request belongs to
+} request_t;
+
+/*
+* Type A requests only reach the alarm thread when a replacement changed the
+* message type of an alarm, since that can leave a display thread useless.
+* The alarm itself lives in the alarm list.
+*/
+typedef struct type_a_request_tag {
+  request_t           request;
+  int                 prev_type; // type the replaced alarm used to have
+} type_a_request_t;
+
+/*
+* Type B request. Stays in type_b_list for as long as its display thread
+* exists, which is what the duplicate check (A.3.2.4) looks at.
+*/
+typedef struct type_b_tag {
+  request_t           request;
+  struct type_b_tag   *link;
+  int                 type;
+} type_b_t;
+
+/*
+* Type C request. Stays in type_c_list until the alarm thread has processed it
+* (A.3.2.7).
+*/
+typedef struct type_c_tag {
+  request_t           request;
+  struct type_c_tag   *link;
+  int                 number;
+} type_c_t;
+
 /*
 *
 * Thread structure used to keep a linked list of thread id's which will be
@@ -56,315 +124,1317 @@ typedef struct thread_tag { // NEW STRUCT
   pthread_t             thread_id;
   int                   type;
   int                   number;
+  struct type_set_tag   *set; // Type A alarms displayed by this thread
 
 } thread_t;
 
-sem_t rw_sem, sem_mutex;
+/*
+* Copy-on-write mode (-C). Writers publish every change of a display set as
+* a new immutable snapshot, which holds copies of everything the display
+* thread prints, and retire the old one. The display thread loads the latest
+* snapshot under a hazard pointer and never takes the read lock for a pass;
+* the deadlines it moves are its own (view_t), carried over from snapshot to
+* snapshot by alarm serial number. Writes get more expensive (a whole snapshot is
+* copied per change), passes get cheaper.
+*/
+typedef struct snapshot_entry_tag {
+  int64_t             time; // first deadline, for an alarm new to the view
+  unsigned long       serial; // of the alarm node
+  int                 seconds;
+  int                 number;
+  char                message[MESSAGE_SIZE];
+} snapshot_entry_t;
+
+typedef struct snapshot_tag {
+  unsigned int        version;
+  int                 count;
+  snapshot_entry_t    entry[];
+} snapshot_t;
+
+/*
+* The display thread's deadlines for the entries of the snapshot "version".
+*/
+typedef struct view_tag {
+  unsigned int        version;
+  int                 count;
+  int                 size; // allocated entries
+  int64_t             *deadline; // deadline[i] is for snapshot entry i
+  unsigned long       *serial; // serial of the alarm of entry i
+  uint32_t            *due; // scratch space for due_scan()
+} view_t;
+
+/*
+* Display set of a message type. Every Type A alarm of a type that has a
+* periodic display thread is kept here, with its deadline copied into one
+* contiguous array so that the display thread can find the due alarms with
+* due_scan() instead of visiting every node of the alarm list.
+*
+* Modified by writers only, except for deadline[] and the replaced notices
+* which belong to the display thread. Freed by the display thread when it is
+* terminated.
+*
+* Every change a writer makes to the set bumps its generation, so that the
+* display thread can tell with one load whether its last pass is still up to
+* date.
+*/
+typedef struct type_set_tag {
+  struct namespace_tag  *ns;
+  int                   type;
+  int                   count; // number of alarms in the set
+  int                   size; // allocated slots
+  int64_t               *deadline; // deadline[i] == alarm[i]->time
+  alarm_t               **alarm;
+  uint32_t              *due; // scratch space for due_scan()
+  int                   *replaced; // new types of alarms replaced away
+  int                   replaced_count;
+  int                   replaced_size;
+  unsigned int          generation; // bumped by every writer change
+  snapshot_t            *snapshot; // latest snapshot, copy-on-write mode only
+  view_t                view; // the display thread's, copy-on-write mode only
+  clock_worker_t        clock; // the display thread as a worker of the clock
+  hazard_t              *hazard; // alarms the display thread is printing
+  double                tokens; // lines the thread may still print, see -L
+  time_t                refilled; // when tokens was last topped up
+  long                  suppressed; // lines not printed because of -L
+} type_set_t;
+
+/*
+* Reader/writer protocol on the alarm lists. The three counters are only
+* accessed with sequentially consistent atomics: a reader announces itself in
+* read_count and then checks ready, a writer announces itself in ready and then
+* checks read_count, so at least one of the two always sees the other.
+*/
+sem_t rw_sem; // taken by the writer, so that there is only one at a time
 int read_count = 0; // number o readers using the list
 int writing = 0; //flag to notify that there is a writer writing to the list
-int ready = 0; // flag to notify readers that a writer is about to write
+int ready = 0; // number of writers that want to write or are writing
 
-alarm_t *alarm_list = NULL;
 time_t current_alarm = 0;
-thread_t *thread_list = NULL;  // List of Thread id's
 
-const int TYPE_A = 1; // Constants to specify alarm request type
-const int TYPE_B = 2;
-const int TYPE_C = 3;
+/*
+* Requests waiting for the alarm thread, oldest first. queue_mutex protects the
+* queue and queue_items counts its requests, so the alarm thread sleeps while
+* there is nothing to do instead of spinning on a flag.
+*/
+request_t *queue_head = NULL, **queue_tail = &queue_head;
+sem_t queue_mutex, queue_items;
+sem_t queue_slots; // free places in the queue, main waits on it when full
+int slots_to_retire = 0; // places "set max_queue" removed that are still in use
+int requests_pending = 0; // requests queued or being handled
+
+/*
+* Admission limits, set from the command line. 0 means no limit. Requests
+* over a limit are rejected with an error instead of being allocated.
+*/
+typedef struct limits_tag {
+  int                 max_alarms; // Type A alarms in the alarm list
+  int                 max_per_type; // Type A alarms of any one message type
+  int                 max_workers; // periodic display threads (Type B requests)
+  long                max_memory; // bytes of alarm and request nodes
+} limits_t;
 
-int insert_flag; //1 if a new alarm has been inserted. set to 0 after processing
+limits_t limits = { 0, 0, 0, 0 }; // quotas given to every new namespace
+int max_queue = 1024; // requests waiting for the alarm thread
+long queue_full = 0; // times main waited for the alarm thread
 
-int debug_flag;
+#define LATE_BUCKETS 5 // under 1 ms, 10 ms, 100 ms, 1 s, and later
 
-/***************************HELPER CODE***************************//////////////
 /*
-* prints out contents of the thread list as well as the contents of the alarm
-* list for debugging
+* Counters printed by the "stats" command.
 */
-void display_lists(){
-  thread_t **last, *next;
-  alarm_t **alast, *anext;
+typedef struct stats_tag {
+  int                 alarms; // Type A alarms in the alarm list
+  long                memory; // bytes of alarm and request nodes in use
+  long                rejected; // requests refused by a limit
+  long                suppressed; // alarm lines dropped by the rate limit
+  long                late[LATE_BUCKETS]; // fired lines by lateness, see late_bucket()
+  long                activations; // display sets created
+  long                activated; // alarms they took when created
+  long                activation_ns; // time spent creating them
+} stats_t;
 
-  last = &thread_list;
-  next = *last;
+/*
+* Number of Type A alarms of each message type, in an open addressing hash
+* table, so that "is there an alarm of this type" and the per type limit do
+* not need a walk of the alarm list. Entries are never removed, a type whose
+* alarms are all gone keeps a count of 0.
+*
+* Only main adds entries (and may grow the table), always as a writer. The
+* counts are atomic, so main can read them without a lock while the alarm
+* thread is removing alarms.
+*
+* Each entry also heads the chain of the type's alarms, in order of message
+* number, so that a new display thread takes all of them in one pass over
+* the chain instead of a walk of the whole alarm list. The chains are only
+* used by writers.
+*/
+typedef struct type_count_tag {
+  int                 type; // 0 == empty entry
+  int                 count;
+  struct alarm_tag    *alarms; // first of the chain
+} type_count_t;
 
-  alast = &alarm_list;
-  anext = *alast;
+/*
+* Registry of the Type B requests of a namespace: an immutable, sorted copy
+* of the message types in type_b_list. Every change to type_b_list publishes
+* a new registry with one atomic store and retires the old one, so main can
+* check for duplicates and count display threads without a lock and without
+* any atomic read-modify-write, see read_registry().
+*/
+typedef struct registry_tag {
+  unsigned int        version; // 1 for the first registry, then counts up
+  int                 count; // Type B requests (display threads)
+  int                 type[]; // their message types, in order
+} registry_t;
 
-  printf ("\n[Thread List: ");
-  for (next = thread_list; next != NULL; next = next->link)
-    printf ("{message type = %d thread_id = <%lu>} ",next->type,next->thread_id);
-  printf ("]\n");
+#define NAME_SIZE 32 // size of a namespace name
 
-  printf ("[Alarm List: ");
-    for (anext = alarm_list; anext != NULL; anext = anext->link)
-      printf (" {Request Type = %d Alarm # = %d message type = %d} ",
-    		  anext->request_type, anext->number, anext->type);
-  printf ("]\n");
-}
+/*
+* A namespace (tenant). Each one has its own alarm store, display threads,
+* type counts and quotas, so message numbers and types of different tenants
+* never meet. All namespaces share the alarm thread, the request queue and
+* the reader/writer protocol.
+*
+* Input lines starting with "@name " go to namespace "name", which is created
+* the first time it is used. Other lines go to the default namespace, whose
+* name is empty.
+*/
+typedef struct namespace_tag {
+  struct namespace_tag  *link;
+  char                  name[NAME_SIZE];
+  alarm_t               *alarm_list; // Type A alarms, in order of message number
+  type_b_t              *type_b_list; // in order of message type
+  registry_t            *registry; // the types in type_b_list, NULL if none
+  type_c_t              *type_c_list; // in order of message number
+  thread_t              *thread_list;  // List of Thread id's
+  type_count_t          *type_counts;
+  int                   type_counts_size; // power of 2
+  int                   type_counts_used;
+  limits_t              limits;
+  stats_t               stats;
+} namespace_t;
+
+namespace_t *namespace_list = NULL; // the default namespace comes first
+hazard_t *input_hazard; // main's hazard record, for the registries
+
+int debug_flag;
+int interactive; // stdin is a terminal, commands come one at a time
 
+#define INPUT_BLOCK 65536 // bytes read at a time by the batch input path
 
 /*
-* checks if an alarm's type has changed
-*
-* returns 1 if so and 0 otherwise
+* Record mode (-R file): every input line is written to the record file as
+* "<seconds>.<nanoseconds> <line>", the time being taken from the monotonic
+* clock relative to the start of the program. The "replay" tool feeds such a
+* file back at its original pace.
 */
-int check_prev(alarm_t *a){
+FILE *record_file = NULL;
+struct timespec record_start;
 
-  if(a->type != a->prev_type)
-    return 1;
+int cow_mode = 0; // -C, display sets are published as snapshots
+long cow_versions = 0; // snapshots published
+long cow_bytes = 0; // bytes copied into them
+unsigned long alarm_serial = 0; // last serial given to an alarm, main only
 
-  return 0;
-}
+/*
+* Rate limit of the display output (-L rate[,burst]): a token bucket per
+* message type. A display thread may print "burst" lines at once, then
+* "rate" lines a second; the alarms it may not print still move to their
+* next deadline, their lines are only counted. 0 means no limit. Changed
+* by "set" under the write lock.
+*/
+double rate_limit = 0; // lines a second per message type
+double rate_burst = 0; // size of the bucket
+
+/*
+* Phase jitter (-J): the first deadline of an alarm is brought forward by a
+* phase between 0 and seconds - 1 taken from a hash of its message number,
+* so that alarms inserted in the same second with the same period are
+* spread over that period instead of all firing at once. Later deadlines
+* keep the period. Read and changed ("set") under the write lock.
+*/
+int jitter = 0;
 
+size_t input_block = INPUT_BLOCK; // bytes read at a time by ingest_batch()
 
 /*
-* Check the alarm list to see if a Type A alarm of this type number exists.
-*
-* return 1 if so and 0 otherwise.
+* Replication, see replica.h: -P path makes this process a primary that
+* sends its input lines to a standby, -Y path a standby of the primary
+* listening there.
+*/
+char *primary_path = NULL; // -P
+char *standby_path = NULL; // -Y
+
+/*
+* Merged display (-M): one display thread serves the display sets of every
+* type of every namespace, instead of one thread per type. A Type B request
+* still creates the set of its type and a thread_t for it, but the set is
+* added to merged_set[] instead of being given a thread; termination takes it
+* out again. The sets are only changed by writers, and the merged thread
+* only reads them under the read lock.
 *
+* Each pass collects the due alarms of all the sets and prints them sorted
+* by deadline (then namespace, type and number), so the lines of different
+* types come out in one deadline order instead of in the order the threads
+* happen to run.
 */
-int check_type_a_exists(int type){
-  int     status;
-  alarm_t *next, **last;
+typedef struct merged_line_tag {
+  int64_t               deadline; // the deadline that fell due
+  struct namespace_tag  *ns;
+  int                   type;
+  int                   number;
+  alarm_t               *alarm; // under the merged thread's hazard pointers
+} merged_line_t;
 
-  last = &alarm_list;
-  next = *last;
-  while (next != NULL) {
-    if(next->type == type && next->request_type == TYPE_A){
+int merged_mode = 0; // -M
+type_set_t **merged_set = NULL; // sets served by the merged display thread
+int merged_count = 0, merged_size = 0;
+unsigned int merged_generation = 0; // bumped by every writer change to a set
+clock_worker_t merged_clock; // the merged thread as a worker of the clock
+pthread_t merged_thread;
 
-      return 1;
-    }
+/***************************HELPER CODE***************************//////////////
+/*
+* Schedule perturbation, compiled in with -DPERTURB (see "make a3-perturb").
+* Every lock and queue operation then gives up the CPU or sleeps a few
+* microseconds at random, so that interleavings which are rare on an idle
+* machine happen often. PERTURB_SEED in the environment makes the random
+* choices of each thread repeatable.
+*/
+#ifdef PERTURB
+static unsigned int perturb_seed = 1;
+static unsigned int perturb_threads = 0;
+
+void perturb(){
+  static __thread unsigned int state;
+  unsigned int r;
+
+  if (state == 0)
+    state = perturb_seed * 2654435761u +
+      __atomic_add_fetch(&perturb_threads, 1, __ATOMIC_RELAXED) * 40503u + 1;
+  state = state * 1103515245u + 12345u;
+  r = (state >> 16) & 0xff;
+  if (r < 64)
+    sched_yield();
+  else if (r < 72)
+    usleep(r);
+}
+#else
+#define perturb()
+#endif
 
-    last = &next->link;
-    next = next->link;
+/*
+* printf for output that belongs to a namespace. Lines of a named namespace
+* start with "@name " so that tenants sharing stdout can tell theirs apart.
+* With -F json or -F binary, the line is written as a note record instead.
+*/
+void ns_vprintf(namespace_t *ns, const char *format, va_list args){
+  char line[EVENT_TEXT_SIZE];
+  int len;
+
+  if (event_format != FORMAT_TEXT){ // a note record
+    len = vsnprintf(line, sizeof(line), format, args);
+    if (len >= (int)sizeof(line))
+      len = sizeof(line) - 1;
+    if (len > 0 && line[len - 1] == '\n')
+      len--;
+    event_write(ns->name, EVENT_NOTE, 0, 0, 0, line, len);
+    return;
   }
+  out_lock(); // keep the prefix and the line together
+  if (ns->name[0] != '\0')
+    out_printf("@%s ", ns->name);
+  out_vprintf(format, args);
+  out_unlock();
+}
 
-  return 0;
+void ns_printf(namespace_t *ns, const char *format, ...){
+  va_list args;
+
+  va_start(args, format);
+  ns_vprintf(ns, format, args);
+  va_end(args);
 }
 
 /*
-* Check the alarm list to see if a Type A alarm of this message number exists.
-*
-* return 1 if so and 0 otherwise.
-*
+* ns_printf for the lines that report events: with -F json or -F binary,
+* the event is written from its fields (see alarm_event.h) and "format" is
+* not used. "message" may be NULL. Lines of kind EVENT_NONE only exist in
+* the text output, another event says the same thing.
 */
-int check_number_a_exists(int num){
-  int     status;
-  alarm_t *next, **last;
-
-  last = &alarm_list;
-  next = *last;
-  while (next != NULL) {
-    if(next->number == num && next->request_type == TYPE_A){
-      return 1;
-    }
-
-    last = &next->link;
-    next = next->link;
+void ns_event(namespace_t *ns, int kind, time_t time, int type, int number,
+  const char *message, const char *format, ...){
+  va_list args;
+
+  if (event_format != FORMAT_TEXT){
+    if (kind != EVENT_NONE)
+      event_write(ns->name, kind, time, type, number, message,
+        message != NULL ? strlen(message) : 0);
+    return;
   }
+  va_start(args, format);
+  ns_vprintf(ns, format, args);
+  va_end(args);
+}
 
-  return 0;
+/*
+* Starts an output line of namespace "ns" in "line" and returns its end.
+*/
+char *start_line(char *line, namespace_t *ns){
+  if (ns->name[0] == '\0')
+    return line;
+  *line++ = '@';
+  line = fmt_string(line, ns->name, NAME_SIZE);
+  *line++ = ' ';
+  return line;
 }
 
 /*
-* Check the alarm list to see if an alarm with this type already exists.
-* Takes the message type and request type as parameters
+* The lines written most often, for every alarm displayed and every Type A
+* request, are put together with the formatters of fmt.h instead of printf.
+* They read exactly like the ns_event() lines they replace:
 *
-* return 1 if so and 0 otherwise.
+*   Alarm With Message Type (%d) and Message Number (%d) Displayed at <%d>:
+*   <Type A> : "%s"
 */
-int check_dup(int type, int req){
-  int     status;
-  alarm_t *next, **last;
-
-  last = &alarm_list;
-  next = *last;
-  while (next != NULL) {
-    if(next->type == type && next->request_type == req){
-      return 1; // it exists already
-    }
-
-    last = &next->link;
-    next = next->link;
+void print_fired(namespace_t *ns, int type, int number, time_t now,
+  const char *message){
+  char line[NAME_SIZE + MESSAGE_SIZE + 4 * FMT_INT_SIZE + 96], *p;
+
+  if (event_format != FORMAT_TEXT){
+    event_write(ns->name, EVENT_FIRED, now, type, number, message,
+      strnlen(message, MESSAGE_SIZE));
+    return;
   }
-  return 0; // It doesn't exist.
+  p = start_line(line, ns);
+  p = fmt_literal(p, "Alarm With Message Type (");
+  p = fmt_int(p, type);
+  p = fmt_literal(p, ") and Message Number (");
+  p = fmt_int(p, number);
+  p = fmt_literal(p, ") Displayed at <");
+  p = fmt_time(p, (int)now);
+  p = fmt_literal(p, ">: <Type A> : \"");
+  p = fmt_string(p, message, MESSAGE_SIZE);
+  p = fmt_literal(p, "\"\n");
+  out_write(line, p - line);
 }
 
 /*
-* Check the alarm list to see if an alarm with this number already exists.
-* Takes the message number and request type as parameters
-*
-* return 1 if so and 0 otherwise.
+*   Type A Alarm Request With Message Number <%d> Received at time <%d>:
+*   <Type A>
 *
+* "kind" is EVENT_INSERTED or EVENT_REPLACED.
 */
-int check_dup_2(int num, int req){
-  int     status;
-  alarm_t *next, **last;
+void print_received(namespace_t *ns, int kind, alarm_t *alarm){
+  char line[NAME_SIZE + 2 * FMT_INT_SIZE + 96], *p;
+  time_t now = clock_now();
+
+  if (event_format != FORMAT_TEXT){
+    event_write(ns->name, kind, now, alarm->type, alarm->number,
+      alarm->message, strnlen(alarm->message, MESSAGE_SIZE));
+    return;
+  }
+  p = start_line(line, ns);
+  p = fmt_literal(p, "Type A Alarm Request With Message Number <");
+  p = fmt_int(p, alarm->number);
+  p = fmt_literal(p, "> Received at time <");
+  p = fmt_time(p, (int)now);
+  p = fmt_literal(p, ">: <Type A>\n");
+  out_write(line, p - line);
+}
 
-  last = &alarm_list;
-  next = *last;
-  while (next != NULL) {
-    if(next->number == num && next->request_type == req){
+/*
+* returns the namespace called "name" ("len" characters), creating it with
+* the default quotas if it does not exist yet. Only main creates namespaces.
+*/
+namespace_t *find_namespace(const char *name, size_t len){
+  namespace_t **last, *next;
 
-      return 1; // it exists already
-    }
+  if (len > NAME_SIZE - 1)
+    len = NAME_SIZE - 1;
+  for (last = &namespace_list; (next = *last) != NULL; last = &next->link)
+    if (strncmp(next->name, name, len) == 0 && next->name[len] == '\0')
+      return next;
 
-    last = &next->link;
-    next = next->link;
+  next = (namespace_t*)calloc (1, sizeof (namespace_t));
+  if (next == NULL)
+    errno_abort ("Allocate namespace");
+  memcpy(next->name, name, len);
+  next->limits = limits;
+  *last = next;
+  return next;
+}
+
+/*
+* prints out contents of the thread list as well as the contents of the alarm
+* list for debugging
+*/
+void display_lists(namespace_t *ns){
+  thread_t *next;
+  alarm_t *anext;
+  type_b_t *bnext;
+  type_c_t *cnext;
+
+  out_lock(); // one block, even with display threads printing
+  if (ns->name[0] != '\0')
+    out_printf ("\n[Namespace: %s]", ns->name);
+  out_printf ("\n[Thread List: ");
+  for (next = ns->thread_list; next != NULL; next = next->link)
+    out_printf ("{message type = %d thread_id = <%lu> alarms = %d} ",next->type,
+      next->thread_id, next->set->count);
+  out_printf ("]\n");
+
+  out_printf ("[Alarm List: ");
+    for (anext = ns->alarm_list; anext != NULL; anext = anext->link)
+      out_printf (" {Request Type = %d Alarm # = %d message type = %d} ",
+    		  TYPE_A, anext->number, anext->type);
+    for (bnext = ns->type_b_list; bnext != NULL; bnext = bnext->link)
+      out_printf (" {Request Type = %d message type = %d} ", TYPE_B, bnext->type);
+    for (cnext = ns->type_c_list; cnext != NULL; cnext = cnext->link)
+      out_printf (" {Request Type = %d Alarm # = %d} ", TYPE_C, cnext->number);
+  out_printf ("]\n");
+  out_unlock();
+}
+
+/*
+* Reader side of the reader/writer protocol on the alarm list.
+*/
+void read_lock(){
+  while (1){
+    while (__atomic_load_n(&ready, __ATOMIC_SEQ_CST) > 0){
+      sched_yield(); // wrtiter is ready to trite so don't do anything
+    }
+    __atomic_add_fetch(&read_count, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ready, __ATOMIC_SEQ_CST) == 0)
+      break;
+    __atomic_sub_fetch(&read_count, 1, __ATOMIC_SEQ_CST); // a writer got in first
+    perturb();
   }
-  return 0; // It doesn't exist.
+  perturb();
+}
+
+void read_unlock(){
+  perturb();
+  __atomic_sub_fetch(&read_count, 1, __ATOMIC_SEQ_CST);
 }
 
 /*
-* Removes a Type A alarm of the specified message number from the alarm list
-*
-* Returns the message type of the alarm that was just removed from alarm list
-*
-* Requires Mutex for alarm list to prevent writing while readers are reading
-* Mutex is needed because this method removes from (writes to) the alarm list
+* Writer side: announce the writer so that no new reader starts, take rw_sem,
+* then wait for the readers to be done.
 */
-int remove_alarm(int number){
-  alarm_t **last, *next;
-  int val = 0;
+void write_lock(){
+  int status;
 
-  /*
-  * LOCKING PROTOCOL:
-  *
-  * This routine requires that the caller have locked the
-  * alarm_mutex!
-  */
-  last = &alarm_list;
-  next = *last;
+  __atomic_add_fetch(&ready, 1, __ATOMIC_SEQ_CST); // the writer is ready
+  perturb();
+  while ((status = sem_wait(&rw_sem)) != 0 && errno == EINTR){
+    // interrupted by a signal, wait again
+  }
+  if(status != 0)
+    errno_abort("rw_sem wait");
+  while (__atomic_load_n(&read_count, __ATOMIC_SEQ_CST) > 0){
+    sched_yield(); // waits for readers to be done
+  }
+  __atomic_store_n(&writing, 1, __ATOMIC_SEQ_CST); // writer has control
+  perturb();
+}
 
-  /*
-  * If list is empty, return 0;
-  */
-  if (next == NULL)
-    return val;
+void write_unlock(){
+  int status;
 
-  while (next != NULL){
+  perturb();
+  __atomic_store_n(&writing, 0, __ATOMIC_SEQ_CST);
+  status = sem_post(&rw_sem);
+  if(status != 0)
+    errno_abort("rw_sem post");
+  __atomic_sub_fetch(&ready, 1, __ATOMIC_SEQ_CST);
+}
 
-    /*
-    * if we find the alarm within the list, delete it.
-    */
-    if (next->number == number && next->request_type == TYPE_A){
-      val = next->type;
-      *last = next->link;
-      free(next);
-      break; // remove the thread the Alarm.
-    }
+/*
+* Waits for a free place in the dispatch queue. Called by main before it
+* takes the write lock for a request it will queue, so that input stops being
+* read while the alarm thread is behind instead of the queue growing without
+* bound.
+*/
+void reserve_queue_slot(){
 
-    last = &next->link;
-    next = next->link;
+  if (sem_trywait(&queue_slots) == 0)
+    return;
+  queue_full++;
+  while (sem_wait(&queue_slots) != 0){
+    // interrupted by a signal, wait again
   }
+}
 
-  return val;
+/*
+* Gives back a place in the dispatch queue, or retires it instead if
+* "set max_queue" has made the queue smaller than the places in use.
+*/
+void release_queue_slot(){
+  int retire = __atomic_load_n(&slots_to_retire, __ATOMIC_RELAXED);
+
+  while (retire > 0)
+    if (__atomic_compare_exchange_n(&slots_to_retire, &retire, retire - 1, 0,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return;
+  sem_post(&queue_slots);
+}
 
+/*
+* Appends a request to the dispatch queue and wakes the alarm thread.
+*/
+void enqueue_request(namespace_t *ns, request_t *request, int request_type){
+  request->request_type = request_type;
+  request->ns = ns;
+  request->next = NULL;
+
+  __atomic_add_fetch(&requests_pending, 1, __ATOMIC_RELAXED);
+  perturb();
+  sem_wait(&queue_mutex);
+  *queue_tail = request;
+  queue_tail = &request->next;
+  sem_post(&queue_mutex);
+  sem_post(&queue_items);
 }
 
 /*
-* Removes a type B alarm request responsible for type A alarms with the
-* specified type
-*
-* Requires Mutex for alarm list to prevent writing while readers are reading
-* Mutex is needed because this method removes from (writes to) the alarm list
+* Takes the oldest request off the dispatch queue, waiting for one if the
+* queue is empty.
 */
-void remove_alarm_B(int type){
-  alarm_t **last, *next;
-  /*
-  * LOCKING PROTOCOL:
-  *
-  * This routine requires that the caller have locked the
-  * alarm_mutex!
-  */
-  last = &alarm_list;
-  next = *last;
+request_t *dequeue_request(){
+  request_t *request;
 
-  while (next != NULL){
-    /*
-    * if we find the alarm within the list, delete it.
-    */
-    if (next->request_type == TYPE_B && next->type == type){
-      *last = next->link;
-      free(next);
-      break; // remove the thread the Alarm.
-    }
+  while (sem_wait(&queue_items) != 0){
+    // interrupted by a signal, wait again
+  }
+  perturb();
+  sem_wait(&queue_mutex);
+  request = queue_head;
+  queue_head = request->next;
+  if (queue_head == NULL)
+    queue_tail = &queue_head;
+  sem_post(&queue_mutex);
+  return request;
+}
 
-    last = &next->link;
-    next = next->link;
-  }// End while
+/*
+* Waits until the alarm thread has handled every queued request.
+*/
+void wait_for_alarm_thread(){
+  while (__atomic_load_n(&requests_pending, __ATOMIC_ACQUIRE) > 0)
+    sched_yield();
 }
 
 
 /*
-* Removes a type C alarm request responsible for cancelling alarms with the
-* specified alarm number type
-*
-* Requires Mutex for alarm list to prevent writing while readers are reading
-* Mutex is needed because this method removes from (writes to) the alarm list
+* returns the entry of the message type in type_counts, or NULL if the type
+* has never had an alarm
 */
-void remove_alarm_C(int number){
-  alarm_t **last, *next;
-  /*
-  * LOCKING PROTOCOL:
-  *
-  * This routine requires that the caller have locked the
-  * alarm_mutex!
-  */
-  last = &alarm_list;
-  next = *last;
+type_count_t *find_type_count(namespace_t *ns, int type){
+  unsigned int i;
+
+  if (ns->type_counts_size == 0)
+    return NULL;
+  for (i = (unsigned int)type * 2654435761u; ; i++){
+    type_count_t *entry = &ns->type_counts[i & (ns->type_counts_size - 1)];
+
+    if (entry->type == type)
+      return entry;
+    if (entry->type == 0)
+      return NULL;
+  }
+}
 
-  while (next != NULL){
-    /*
-    * if we find the alarm within the list, delete it.
-    */
-    if (next->request_type == TYPE_C && next->number == number){
-      *last = next->link;
-      free(next);
-      break; // remove the thread the Alarm.
-    }
+/*
+* returns the number of Type A alarms of the message type
+*/
+int type_count(namespace_t *ns, int type){
+  type_count_t *entry = find_type_count(ns, type);
 
-    last = &next->link;
-    next = next->link;
-  }// End while
+  return entry != NULL ? __atomic_load_n(&entry->count, __ATOMIC_ACQUIRE) : 0;
 }
 
 /*
-* Insert alarm entry on list, in order of message number.
+* Adds "delta" to the count of the message type, creating its entry (and
+* doubling the table at half load) if needed.
 *
-* Requires Mutex for alarm list to prevent writing while readers are reading
-* Mutex is needed because this method removes from (writes to) the alarm list
+* Requires the caller to be a writer of the alarm list.
 */
-void alarm_insert (alarm_t *alarm){
-  int status;
-  alarm_t **last, *next;
+void add_type_count(namespace_t *ns, int type, int delta){
+  type_count_t *entry = find_type_count(ns, type), *old;
+  int i, old_size;
+  unsigned int h;
+
+  if (entry == NULL){
+    if (2 * (ns->type_counts_used + 1) > ns->type_counts_size){
+      old = ns->type_counts;
+      old_size = ns->type_counts_size;
+      ns->type_counts_size = old_size == 0 ? 64 : old_size * 2;
+      ns->type_counts = calloc(ns->type_counts_size, sizeof(type_count_t));
+      if (ns->type_counts == NULL)
+        errno_abort ("Allocate type counts");
+      ns->type_counts_used = 0;
+      for (i = 0; i < old_size; i++)
+        if (old[i].type != 0){
+          add_type_count(ns, old[i].type, old[i].count);
+          find_type_count(ns, old[i].type)->alarms = old[i].alarms;
+        }
+      free(old);
+    }
+    for (h = (unsigned int)type * 2654435761u;
+      ns->type_counts[h & (ns->type_counts_size - 1)].type != 0; h++)
+      ;
+    entry = &ns->type_counts[h & (ns->type_counts_size - 1)];
+    entry->type = type;
+    entry->count = 0;
+    entry->alarms = NULL;
+    ns->type_counts_used++;
+  }
+  __atomic_add_fetch(&entry->count, delta, __ATOMIC_RELEASE);
+}
 
-  /*
+/*
+* Links an alarm into the chain of its type after "before", the alarm of the
+* same type with the next lower message number (NULL if there is none), and
+* counts it.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void type_chain_add(namespace_t *ns, alarm_t *alarm, alarm_t *before){
+  type_count_t *entry;
+
+  add_type_count(ns, alarm->type, 1);
+  alarm->type_prev = before;
+  if (before != NULL){
+    alarm->type_link = before->type_link;
+    before->type_link = alarm;
+  }else{
+    entry = find_type_count(ns, alarm->type);
+    alarm->type_link = entry->alarms;
+    entry->alarms = alarm;
+  }
+  if (alarm->type_link != NULL)
+    alarm->type_link->type_prev = alarm;
+}
+
+/*
+* Unlinks an alarm from the chain of its type and uncounts it.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void type_chain_remove(namespace_t *ns, alarm_t *alarm){
+  if (alarm->type_prev != NULL)
+    alarm->type_prev->type_link = alarm->type_link;
+  else
+    find_type_count(ns, alarm->type)->alarms = alarm->type_link;
+  if (alarm->type_link != NULL)
+    alarm->type_link->type_prev = alarm->type_prev;
+  add_type_count(ns, alarm->type, -1);
+}
+
+/*
+* Accounts for "bytes" of node memory being allocated (or freed, when
+* negative). Called from main and from the alarm thread.
+*/
+void add_memory(namespace_t *ns, long bytes){
+  __atomic_add_fetch(&ns->stats.memory, bytes, __ATOMIC_RELAXED);
+}
+
+/*
+* returns 1 if allocating "bytes" more would go over the memory limit
+*/
+int over_memory(namespace_t *ns, long bytes){
+  return ns->limits.max_memory > 0 &&
+    __atomic_load_n(&ns->stats.memory, __ATOMIC_RELAXED) + bytes > ns->limits.max_memory;
+}
+
+/*
+* returns the display set of the message type, or NULL if there is no periodic
+* display thread for that type.
+*/
+type_set_t *find_set(namespace_t *ns, int type){
+  thread_t *next;
+
+  for (next = ns->thread_list; next != NULL && next->type <= type; next = next->link)
+    if (next->type == type)
+      return next->set;
+
+  return NULL;
+}
+
+/*
+* Publishes the current contents of a display set as a new snapshot and
+* retires the previous one. Copy-on-write mode only.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void publish_set(type_set_t *set){
+  snapshot_t *old = set->snapshot, *snapshot;
+  size_t bytes = sizeof(snapshot_t) + set->count * sizeof(snapshot_entry_t);
+  alarm_t *alarm;
+  int i;
+
+  snapshot = malloc(bytes);
+  if (snapshot == NULL)
+    errno_abort ("Allocate snapshot");
+  snapshot->version = old != NULL ? old->version + 1 : 1;
+  snapshot->count = set->count;
+  for (i = 0; i < set->count; i++){
+    alarm = set->alarm[i];
+    snapshot->entry[i].time = alarm->time;
+    snapshot->entry[i].serial = alarm->serial;
+    snapshot->entry[i].seconds = alarm->seconds;
+    snapshot->entry[i].number = alarm->number;
+    memcpy(snapshot->entry[i].message, alarm->message, strlen(alarm->message) + 1);
+  }
+  cow_versions++;
+  cow_bytes += bytes;
+
+  __atomic_store_n(&set->snapshot, snapshot, __ATOMIC_SEQ_CST);
+  if (old != NULL)
+    hazard_retire(old, free); // the display thread may be reading it
+}
+
+/*
+* Returns the first deadline of an alarm inserted or anchored at "now": one
+* period ahead, less the alarm's phase with -J. The phase is the same on
+* every run for the same message number and period.
+*/
+time_t first_deadline(alarm_t *alarm, time_t now){
+  unsigned int phase;
+
+  if (!jitter || alarm->seconds <= 1)
+    return now + alarm->seconds;
+  phase = ((unsigned int)alarm->number * 2654435761u >> 16) % alarm->seconds;
+  return now + alarm->seconds - phase;
+}
+
+/*
+* Makes room for "size" alarms in a display set.
+*/
+void set_grow(type_set_t *set, int size){
+  set->size = size;
+  set->deadline = realloc(set->deadline, set->size * sizeof(int64_t));
+  set->alarm = realloc(set->alarm, set->size * sizeof(alarm_t *));
+  set->due = realloc(set->due, set->size * sizeof(uint32_t));
+  if (set->deadline == NULL || set->alarm == NULL || set->due == NULL)
+    errno_abort ("Allocate display set");
+}
+
+/*
+* Records a writer change to a display set: bumps its generation, and the
+* merged one that the merged display thread checks.
+*/
+void set_changed(type_set_t *set){
+  __atomic_add_fetch(&set->generation, 1, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&merged_generation, 1, __ATOMIC_RELEASE);
+}
+
+/*
+* Returns the clock worker that displays the alarms of a set: the set's own
+* display thread, or the merged display thread with -M.
+*/
+clock_worker_t *set_worker(type_set_t *set){
+  return merged_mode ? &merged_clock : &set->clock;
+}
+
+/*
+* Adds a Type A alarm to a display set. An alarm that has not been displayed
+* before gets its first deadline relative to now.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void set_add(type_set_t *set, alarm_t *alarm){
+
+  if (set->count == set->size)
+    set_grow(set, set->size == 0 ? 16 : set->size * 2);
+
+  if (alarm->first == 1){
+    alarm->time = first_deadline(alarm, clock_now());
+    alarm->first = 0;
+  }
+  alarm->slot = set->count++;
+  set->alarm[alarm->slot] = alarm;
+  set->deadline[alarm->slot] = alarm->time;
+  if (alarm->time < set_worker(set)->next)
+    set_worker(set)->next = alarm->time; // so that an advance does not skip it
+  if (set->snapshot != NULL)
+    publish_set(set);
+  set_changed(set);
+}
+
+/*
+* Removes an alarm from its display set by moving the last alarm of the set
+* into its slot.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void set_remove(type_set_t *set, alarm_t *alarm){
+  int last = --set->count;
+
+  if (alarm->slot != last){
+    set->alarm[alarm->slot] = set->alarm[last];
+    set->deadline[alarm->slot] = set->deadline[last];
+    set->alarm[alarm->slot]->slot = alarm->slot;
+  }
+  alarm->slot = -1;
+  if (set->snapshot != NULL)
+    publish_set(set);
+  set_changed(set);
+}
+
+/*
+* Queues the "Replaced" notice for a display thread whose alarm was replaced by
+* one of a different message type.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void set_notice(type_set_t *set, int new_type){
+
+  if (set->replaced_count == set->replaced_size){
+    set->replaced_size = set->replaced_size == 0 ? 4 : set->replaced_size * 2;
+    set->replaced = realloc(set->replaced, set->replaced_size * sizeof(int));
+    if (set->replaced == NULL)
+      errno_abort ("Allocate replaced notices");
+  }
+  set->replaced[set->replaced_count] = new_type;
+  __atomic_store_n(&set->replaced_count, set->replaced_count + 1, __ATOMIC_RELEASE);
+  set_worker(set)->next = INT64_MIN; // printed at the next advance
+  set_changed(set);
+}
+
+/*
+* Creates the display set for a message type from the Type A alarms of that
+* type currently in the alarm list. They are taken in bulk: the set is
+* allocated once at their number, and one pass over the type's chain gives
+* the dormant ones their first deadline and fills the deadline array, so the
+* cost is linear in the alarms of the type alone.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+type_set_t *create_set(namespace_t *ns, int type){
+  type_set_t *set;
+  type_count_t *entry = find_type_count(ns, type);
+  alarm_t *next;
+  struct timespec start, end;
+  time_t now;
+
+  set = (type_set_t*)calloc (1, sizeof (type_set_t));
+  if (set == NULL)
+    errno_abort ("Allocate display set");
+  set->ns = ns;
+  set->type = type;
+  set->tokens = rate_burst;
+  set->refilled = now = clock_now();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (entry != NULL && entry->count > 0)
+    set_grow(set, entry->count > 16 ? entry->count : 16);
+  for (next = entry != NULL ? entry->alarms : NULL; next != NULL;
+    next = next->type_link){
+    if (next->first == 1){
+      next->time = first_deadline(next, now);
+      next->first = 0;
+    }
+    next->slot = set->count++;
+    set->alarm[next->slot] = next;
+    set->deadline[next->slot] = next->time;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns->stats.activations++;
+  ns->stats.activated += set->count;
+  ns->stats.activation_ns += (end.tv_sec - start.tv_sec) * 1000000000L +
+    (end.tv_nsec - start.tv_nsec);
+  if (cow_mode)
+    publish_set(set); // from now on every change is published
+
+  return set;
+}
+
+/*
+* Frees a display set, see cancel_set(); with -M, called by the writer that
+* takes the set out of merged_set[].
+*/
+void free_set(void *arg){
+  type_set_t *set = arg;
+
+  if (!merged_mode)
+    clock_leave(&set->clock);
+  if (set->hazard != NULL)
+    hazard_release(set->hazard);
+  free(set->deadline);
+  free(set->alarm);
+  free(set->due);
+  free(set->replaced);
+  free(set->snapshot); // no writer can reach the set any more
+  free(set->view.deadline);
+  free(set->view.serial);
+  free(set->view.due);
+  free(set);
+}
+
+/*
+* Cancellation cleanup handler of a periodic display thread: frees its set.
+* The writer that cancelled the thread changed the set last and may still
+* hold the write lock; going through the read lock first orders its changes
+* before the free, which pthread_cancel() alone does not show to
+* ThreadSanitizer.
+*/
+void cancel_set(void *arg){
+  read_lock();
+  read_unlock();
+  free_set(arg);
+}
+
+/*
+* Hands a new display set to the merged display thread (-M).
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void merged_add(type_set_t *set){
+
+  if (merged_count == merged_size){
+    merged_size = merged_size == 0 ? 16 : merged_size * 2;
+    merged_set = realloc(merged_set, merged_size * sizeof(type_set_t *));
+    if (merged_set == NULL)
+      errno_abort ("Allocate merged display");
+  }
+  merged_set[merged_count++] = set;
+  merged_clock.next = INT64_MIN; // its first pass is at the next advance
+  __atomic_add_fetch(&merged_generation, 1, __ATOMIC_RELEASE);
+}
+
+/*
+* Takes a display set away from the merged display thread and frees it. The
+* thread only uses the sets under the read lock, and what it prints after
+* releasing it is copied out or protected by its hazard pointers.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void merged_remove(type_set_t *set){
+  int i;
+
+  for (i = 0; i < merged_count; i++)
+    if (merged_set[i] == set){
+      memmove(&merged_set[i], &merged_set[i + 1],
+        (merged_count - i - 1) * sizeof(type_set_t *));
+      merged_count--;
+      break;
+    }
+  __atomic_add_fetch(&merged_generation, 1, __ATOMIC_RELEASE);
+  free_set(set);
+}
+
+/*
+* Check the alarm list to see if a Type A alarm of this type number exists.
+*
+* return 1 if so and 0 otherwise.
+*
+*/
+int check_type_a_exists(namespace_t *ns, int type){
+  return type_count(ns, type) > 0;
+}
+
+/*
+* returns the Type A alarm with this message number, or NULL if there is none
+*/
+alarm_t *find_alarm(namespace_t *ns, int num){
+  alarm_t *next;
+
+  for (next = ns->alarm_list; next != NULL && next->number <= num; next = next->link)
+    if(next->number == num)
+      return next;
+
+  return NULL;
+}
+
+/*
+* Check the alarm list to see if a Type A alarm of this message number exists.
+*
+* return 1 if so and 0 otherwise.
+*
+*/
+int check_number_a_exists(namespace_t *ns, int num){
+  return find_alarm(ns, num) != NULL;
+}
+
+/*
+* returns the current registry of the namespace (NULL if it has no Type B
+* request), protected by main's hazard pointer until the next call. No lock
+* needed: if the registry is replaced between the load and the hazard being
+* published, the second load sees it and the loop tries again.
+*
+* Main only.
+*/
+registry_t *read_registry(namespace_t *ns){
+  registry_t *registry;
+
+  do{
+    registry = __atomic_load_n(&ns->registry, __ATOMIC_ACQUIRE);
+    hazard_set(input_hazard, registry);
+  }while (registry != __atomic_load_n(&ns->registry, __ATOMIC_SEQ_CST));
+  return registry;
+}
+
+/*
+* Publishes a new registry with "type" added (or removed, when "add" is 0)
+* and retires the old one.
+*
+* Requires the caller to be a writer of the alarm list.
+*/
+void update_registry(namespace_t *ns, int type, int add){
+  registry_t *old = ns->registry, *registry;
+  int count = old != NULL ? old->count : 0, i, j;
+
+  registry = malloc(sizeof(registry_t) + (count + 1) * sizeof(int));
+  if (registry == NULL)
+    errno_abort ("Allocate registry");
+  registry->version = old != NULL ? old->version + 1 : 1;
+  for (i = j = 0; i < count && old->type[i] < type; i++)
+    registry->type[j++] = old->type[i];
+  if (add)
+    registry->type[j++] = type;
+  else if (i < count && old->type[i] == type)
+    i++;
+  for (; i < count; i++)
+    registry->type[j++] = old->type[i];
+  registry->count = j;
+
+  __atomic_store_n(&ns->registry, registry, __ATOMIC_SEQ_CST);
+  if (old != NULL)
+    hazard_retire(old, free); // main may be reading it
+}
+
+/*
+* Check the Type B registry to see if a Type B request for this message type
+* already exists.
+*
+* return 1 if so and 0 otherwise.
+*/
+int check_dup(registry_t *registry, int type){
+  int low = 0, high = registry != NULL ? registry->count : 0, mid;
+
+  while (low < high){ // binary search of the sorted types
+    mid = (low + high) / 2;
+    if (registry->type[mid] == type)
+      return 1; // it exists already
+    if (registry->type[mid] < type)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return 0; // It doesn't exist.
+}
+
+/*
+* Check the Type C list to see if a Type C request for this message number is
+* already waiting to be processed.
+*
+* return 1 if so and 0 otherwise.
+*
+*/
+int check_dup_2(namespace_t *ns, int num){
+  type_c_t *next;
+
+  for (next = ns->type_c_list; next != NULL && next->number <= num; next = next->link)
+    if(next->number == num)
+      return 1; // it exists already
+
+  return 0; // It doesn't exist.
+}
+
+/*
+* Removes a Type A alarm of the specified message number from the alarm list
+*
+* Returns the message type of the alarm that was just removed from alarm list
+*
+* Requires Mutex for alarm list to prevent writing while readers are reading
+* Mutex is needed because this method removes from (writes to) the alarm list
+*/
+int remove_alarm(namespace_t *ns, int number){
+  alarm_t **last, *next;
+  int val = 0;
+
+  /*
   * LOCKING PROTOCOL:
   *
   * This routine requires that the caller have locked the
   * alarm_mutex!
   */
-  last = &alarm_list;
+  last = &ns->alarm_list;
+  next = *last;
+
+  /*
+  * If list is empty, return 0;
+  */
+  if (next == NULL)
+    return val;
+
+  while (next != NULL){
+
+    /*
+    * if we find the alarm within the list, delete it.
+    */
+    if (next->number == number){
+      val = next->type;
+      if (next->slot >= 0)
+        set_remove(find_set(ns, next->type), next);
+      *last = next->link;
+      type_chain_remove(ns, next);
+      ns->stats.alarms--;
+      add_memory(ns, -(long)alarm_bytes(next->message));
+      hazard_retire(next, free); // a display thread may still be printing it
+      break; // remove the thread the Alarm.
+    }
+
+    last = &next->link;
+    next = next->link;
+  }
+
+  return val;
+
+}
+
+/*
+* Removes a type B alarm request responsible for type A alarms with the
+* specified type
+*
+* Requires Mutex for alarm list to prevent writing while readers are reading
+* Mutex is needed because this method removes from (writes to) the alarm list
+*/
+void remove_alarm_B(namespace_t *ns, int type){
+  type_b_t **last, *next;
+  /*
+  * LOCKING PROTOCOL:
+  *
+  * This routine requires that the caller have locked the
+  * alarm_mutex!
+  */
+  last = &ns->type_b_list;
+  next = *last;
+
+  while (next != NULL){
+    /*
+    * if we find the alarm within the list, delete it.
+    */
+    if (next->type == type){
+      *last = next->link;
+      update_registry(ns, type, 0);
+      add_memory(ns, -(long)sizeof(type_b_t));
+      free(next);
+      break; // remove the thread the Alarm.
+    }
+
+    last = &next->link;
+    next = next->link;
+  }// End while
+}
+
+
+/*
+* Removes a type C alarm request responsible for cancelling alarms with the
+* specified alarm number type
+*
+* Requires Mutex for alarm list to prevent writing while readers are reading
+* Mutex is needed because this method removes from (writes to) the alarm list
+*/
+void remove_alarm_C(namespace_t *ns, int number){
+  type_c_t **last, *next;
+  /*
+  * LOCKING PROTOCOL:
+  *
+  * This routine requires that the caller have locked the
+  * alarm_mutex!
+  */
+  last = &ns->type_c_list;
+  next = *last;
+
+  while (next != NULL){
+    /*
+    * if we find the alarm within the list, delete it.
+    */
+    if (next->number == number){
+      *last = next->link;
+      add_memory(ns, -(long)sizeof(type_c_t));
+      free(next);
+      break; // remove the thread the Alarm.
+    }
+
+    last = &next->link;
+    next = next->link;
+  }// End while
+}
+
+/*
+* Insert a Type B request into the Type B list, in order of message type.
+*
+* Requires Mutex for alarm list to prevent writing while readers are reading
+*/
+void insert_type_b(namespace_t *ns, type_b_t *b){
+  type_b_t **last = &ns->type_b_list;
+
+  while (*last != NULL && (*last)->type < b->type)
+    last = &(*last)->link;
+  b->link = *last;
+  *last = b;
+  update_registry(ns, b->type, 1);
+}
+
+/*
+* Insert a Type C request into the Type C list, in order of message number.
+*
+* Requires Mutex for alarm list to prevent writing while readers are reading
+*/
+void insert_type_c(namespace_t *ns, type_c_t *c){
+  type_c_t **last = &ns->type_c_list;
+
+  while (*last != NULL && (*last)->number < c->number)
+    last = &(*last)->link;
+  c->link = *last;
+  *last = c;
+}
+
+/*
+* Insert alarm entry on list, in order of message number.
+*
+* Requires Mutex for alarm list to prevent writing while readers are reading
+* Mutex is needed because this method removes from (writes to) the alarm list
+*/
+void alarm_insert(namespace_t *ns, alarm_t *alarm){
+  alarm_t **last, *next, *before = NULL; // see type_chain_add()
+  type_set_t *set;
+
+  /*
+  * LOCKING PROTOCOL:
+  *
+  * This routine requires that the caller have locked the
+  * alarm_mutex!
+  */
+  last = &ns->alarm_list;
   next = *last;
   while (next != NULL) {
 
     /*
     * Replace existing alarm or insert the new alarm arranged by message number.
-    *
-    * If the alarm is a type B request, it will be inserted in the front as it
-    * has a Message Number of 0.
-    * If the alarm is a type C request, it will be inserted along Type A's.
     */
-    if (next->number == alarm->number && alarm->request_type == TYPE_A){//A.3.2.2
+    if (next->number == alarm->number){//A.3.2.2
 
       // swap the nodes (Replacement)
       alarm->link = next->link;
       alarm->prev_type = next->type;
       *last = alarm;
-      free(next);
-      printf("Type A Replacement Alarm Request With Message Number (%d) "
-      "Received at <%d>: <A>\n", alarm->number, (int)time(NULL));
+      if (next->slot >= 0)
+        set_remove(find_set(ns, next->type), next);
+      if (next->type != alarm->type && (set = find_set(ns, next->type)) != NULL)
+        set_notice(set, alarm->type); // A.3.4.2, printed by the display thread
+      type_chain_remove(ns, next);
+      ns->stats.alarms--;
+      add_memory(ns, -(long)alarm_bytes(next->message));
+      hazard_retire(next, free); // a display thread may still be printing it
+      ns_event(ns, EVENT_NONE, 0, 0, 0, NULL, // accept_type_a() reports it
+      "Type A Replacement Alarm Request With Message Number (%d) "
+      "Received at <%d>: <A>\n", alarm->number, (int)clock_now());
       break; // Add the Alarm.
 
     }else if (next->number > alarm->number){
@@ -375,6 +1445,8 @@ void alarm_insert (alarm_t *alarm){
 
      }
 
+    if (next->type == alarm->type)
+      before = next;
     last = &next->link;
     next = next->link;
   }
@@ -387,6 +1459,11 @@ void alarm_insert (alarm_t *alarm){
     *last = alarm;
     alarm->link = NULL;
   }
+
+  type_chain_add(ns, alarm, before);
+  ns->stats.alarms++;
+  if ((set = find_set(ns, alarm->type)) != NULL)
+    set_add(set, alarm);
 }
 
 ///THREAD STUFF
@@ -395,11 +1472,11 @@ void alarm_insert (alarm_t *alarm){
 * insert thread id into the thread list in order of Message Type
 *
 */
-void insert_thread(thread_t *thread){
+void insert_thread(namespace_t *ns, thread_t *thread){
 
   thread_t **last, *next;
 
-  last = &thread_list;
+  last = &ns->thread_list;
   next = *last;
   while (next != NULL) {
 
@@ -437,9 +1514,9 @@ void insert_thread(thread_t *thread){
 * this is to avoid the mutex being locked and not having a way to unlock it
 *
 */
-void terminate_thread(int type){
+void terminate_thread(namespace_t *ns, int type){
   thread_t **last, *next;
-  last = &thread_list;
+  last = &ns->thread_list;
   next = *last;
 
   while (next != NULL){
@@ -449,9 +1526,14 @@ void terminate_thread(int type){
     */
     if (next->type == type){
 
-      int success = pthread_cancel(next->thread_id); //terminate that thread
-      if(success != 0) // checks if the thread was successfuly terminated
-        err_abort (success, "thread was not canceled");
+      if (merged_mode)
+        merged_remove(next->set); // the merged thread goes on with the others
+      else{
+        int success = pthread_cancel(next->thread_id); //terminate that thread
+        if(success != 0) // checks if the thread was successfuly terminated
+          err_abort (success, "thread was not canceled");
+        pthread_detach(next->thread_id); // nobody joins display threads
+      }
 
       *last = next->link;
       free(next);
@@ -463,529 +1545,1510 @@ void terminate_thread(int type){
   }// End while
 }
 
-/*
-*
-* Check the thread list to see if there are any useless threads in the list.
-* A thread is considered useless if there are no Type A alarms of its message
-* type available to be printed
-*
-* terminate the thread if such thread exists and return 1. If no such thread
-* exists, return 0
+/*
+* When debug mode is activated, prints out the contents of the alarm list as
+* well as the thread list. Also prints out the values for the semaphore
+* variables (during the time debug is called) used for mutual exclusion.
+*
+*/
+void debug(namespace_t *ns){
+
+  if (debug_flag){
+    out_lock();
+    display_lists(ns);
+    out_printf("Ready = %d read_count = %d writing = %d\n\n",
+    __atomic_load_n(&ready, __ATOMIC_SEQ_CST),
+    __atomic_load_n(&read_count, __ATOMIC_SEQ_CST),
+    __atomic_load_n(&writing, __ATOMIC_SEQ_CST));
+    out_unlock();
+  }
+
+}
+/***************************END HELPER CODE***************************//////////
+
+
+/* READER
+*
+* Prints the "Replaced" notices queued for a display thread.
+*
+* Requires the caller to be a reader of the alarm list.
+*/
+void print_notices(type_set_t *set){
+  int i;
+
+  /*
+  * notify the user that an alarm which previously had this thread's type
+  * has been assigned a different one. A.3.4.2
+  */
+  for (i = 0; i < set->replaced_count; i++)
+    ns_event(set->ns, EVENT_MOVED, clock_now(), set->replaced[i], 0, NULL,
+    "Alarm With Message Type (%d) Replaced at <%d>: "
+    "<Type A>\n", set->replaced[i], (int)clock_now()); // A.3.4.2
+  __atomic_store_n(&set->replaced_count, 0, __ATOMIC_RELEASE);
+}
+
+/*
+* Takes a token from the bucket of the set for one line displayed at "now".
+* Returns 0, and counts the line as suppressed, when the bucket is empty.
+* Only the set's display thread uses the bucket; the counters are atomic
+* for "stats", and the limit is loaded atomically since "set" may change it.
+*/
+int rate_allow(type_set_t *set, time_t now){
+  double rate, burst;
+
+  __atomic_load(&rate_limit, &rate, __ATOMIC_RELAXED);
+  if (rate <= 0)
+    return 1;
+  __atomic_load(&rate_burst, &burst, __ATOMIC_RELAXED);
+  if (now > set->refilled){
+    set->tokens += (now - set->refilled) * rate;
+    if (set->tokens > burst)
+      set->tokens = burst;
+    set->refilled = now;
+  }
+  if (set->tokens >= 1){
+    set->tokens -= 1;
+    return 1;
+  }
+  __atomic_add_fetch(&set->suppressed, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&set->ns->stats.suppressed, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/*
+* Lateness of a fired line on the real clock: the bucket of the time between
+* the start of the second "now" the line is displayed at and the moment it
+* reaches the output, under 1 ms, 10 ms, 100 ms, 1 s or later. A pass that
+* has many lines due at once shows up as lines in the later buckets.
+*/
+int late_bucket(time_t now){
+  static const long limit[LATE_BUCKETS - 1] = { 1000000, 10000000, 100000000,
+    1000000000 }; // nanoseconds
+  struct timespec out;
+  long late;
+  int bucket;
+
+  clock_gettime(CLOCK_REALTIME, &out);
+  late = out.tv_sec > now ? 1000000000 : out.tv_nsec;
+  for (bucket = 0; bucket < LATE_BUCKETS - 1 && late >= limit[bucket]; bucket++)
+    ;
+  return bucket;
+}
+
+/*
+* Adds the lateness counts of one pass to the namespace's, for "stats".
+*/
+void add_lateness(namespace_t *ns, const long late[LATE_BUCKETS]){
+  int i;
+
+  for (i = 0; i < LATE_BUCKETS; i++)
+    if (late[i] > 0)
+      __atomic_add_fetch(&ns->stats.late[i], late[i], __ATOMIC_RELAXED);
+}
+
+/* READER
+*
+* One pass of a display thread over its display set. Only finding the due
+* alarms and moving their deadlines is done under the read lock. The due
+* alarms are published as hazard pointers and printed after the lock is
+* released, so that writers do not wait for stdout; an alarm removed
+* meanwhile is retired and freed only after it was printed.
+*
+* Stores the generation of the set in "seen" and returns the earliest
+* deadline, where the next pass has to start.
+*/
+int64_t locked_pass(type_set_t *set, unsigned int *seen){
+  alarm_t *alarm;
+  size_t i, due;
+  time_t now;
+  int64_t next;
+  long late[LATE_BUCKETS] = { 0 };
+  int timed = !clock_is_simulated();
+
+  read_lock();
+  print_notices(set);
+
+  now = clock_now();
+  due = due_scan(set->deadline, set->count, now, set->due);
+  for (i = 0; i < due; i++){ //A.3.4.1
+    alarm = set->alarm[set->due[i]];
+    hazard_protect(set->hazard, alarm); // printed below, outside the lock
+    alarm->time = now + alarm->seconds;
+    set->deadline[set->due[i]] = alarm->time;
+  }
+
+  /*
+  * no writer can change the set while the read lock is held
+  */
+  *seen = __atomic_load_n(&set->generation, __ATOMIC_ACQUIRE);
+  for (next = INT64_MAX, i = 0; i < (size_t)set->count; i++)
+    if (set->deadline[i] < next)
+      next = set->deadline[i];
+
+  read_unlock();
+
+  for (i = 0; i < due; i++){
+    alarm = set->hazard->pointer[i];
+    // PRINT MESSAGE // A.3.4.1
+    if (rate_allow(set, now)){
+      print_fired(set->ns, alarm->type, alarm->number, now, alarm->message);
+      if (timed)
+        late[late_bucket(now)]++;
+    }
+  }
+  hazard_clear(set->hazard);
+  if (timed && due > 0)
+    add_lateness(set->ns, late);
+  return next;
+}
+
+/*
+* Moves a display thread's view to a newer snapshot. Alarms that were in the
+* old view keep their deadlines (found by serial through a small hash
+* table), new ones start at the deadline the writer gave them.
+*/
+void update_view(view_t *view, snapshot_t *snapshot){
+  int64_t *deadline;
+  unsigned long *serial;
+  int *index, i, j, size = 16;
+  unsigned int h, mask;
+
+  while (size < 2 * view->count)
+    size *= 2;
+  mask = size - 1;
+  index = malloc(size * sizeof(int));
+  deadline = malloc((snapshot->count + 1) * sizeof(int64_t));
+  serial = malloc((snapshot->count + 1) * sizeof(unsigned long));
+  if (index == NULL || deadline == NULL || serial == NULL)
+    errno_abort ("Allocate view");
+
+  for (i = 0; i < size; i++)
+    index[i] = -1;
+  for (j = 0; j < view->count; j++){
+    for (h = (unsigned int)view->serial[j] * 2654435761u; index[h & mask] >= 0; h++)
+      ;
+    index[h & mask] = j;
+  }
+
+  for (i = 0; i < snapshot->count; i++){
+    serial[i] = snapshot->entry[i].serial;
+    deadline[i] = snapshot->entry[i].time;
+    for (h = (unsigned int)serial[i] * 2654435761u; (j = index[h & mask]) >= 0; h++)
+      if (view->serial[j] == serial[i]){
+        deadline[i] = view->deadline[j];
+        break;
+      }
+  }
+
+  if (snapshot->count > view->size){
+    view->size = snapshot->count;
+    view->due = realloc(view->due, view->size * sizeof(uint32_t));
+    if (view->due == NULL)
+      errno_abort ("Allocate view");
+  }
+  free(index);
+  free(view->deadline);
+  free(view->serial);
+  view->deadline = deadline;
+  view->serial = serial;
+  view->count = snapshot->count;
+  view->version = snapshot->version;
+}
+
+/*
+* One pass of a display thread in copy-on-write mode: the same as
+* locked_pass(), but over the latest snapshot of the set and the thread's
+* own deadlines, so the read lock is only taken to print "Replaced" notices.
+*/
+int64_t snapshot_pass(type_set_t *set, unsigned int *seen){
+  snapshot_t *snapshot;
+  view_t *view = &set->view;
+  snapshot_entry_t *entry;
+  size_t i, due;
+  time_t now;
+  int64_t next;
+  long late[LATE_BUCKETS] = { 0 };
+  int timed = !clock_is_simulated();
+
+  if (__atomic_load_n(&set->replaced_count, __ATOMIC_ACQUIRE) > 0){
+    read_lock();
+    print_notices(set);
+    read_unlock();
+  }
+
+  /*
+  * the generation first: a change published after it is seen next time
+  */
+  *seen = __atomic_load_n(&set->generation, __ATOMIC_ACQUIRE);
+  do{
+    snapshot = __atomic_load_n(&set->snapshot, __ATOMIC_ACQUIRE);
+    hazard_set(set->hazard, snapshot);
+  }while (snapshot != __atomic_load_n(&set->snapshot, __ATOMIC_SEQ_CST));
+  if (snapshot->version != view->version)
+    update_view(view, snapshot);
+
+  now = clock_now();
+  due = due_scan(view->deadline, view->count, now, view->due);
+  for (i = 0; i < due; i++){ //A.3.4.1
+    entry = &snapshot->entry[view->due[i]];
+    // PRINT MESSAGE // A.3.4.1
+    if (rate_allow(set, now)){
+      print_fired(set->ns, set->type, entry->number, now, entry->message);
+      if (timed)
+        late[late_bucket(now)]++;
+    }
+    view->deadline[view->due[i]] = now + entry->seconds;
+  }
+
+  for (next = INT64_MAX, i = 0; i < (size_t)view->count; i++)
+    if (view->deadline[i] < next)
+      next = view->deadline[i];
+  hazard_clear(set->hazard);
+  if (timed && due > 0)
+    add_lateness(set->ns, late);
+  return next;
+}
+
+/* READER
+*
+* TYPE B CREATED THREAD (periodic display thread).
+* responsible for periodically looking up the Type A alarm requests of its
+* Message Type, then printing each of them every Time seconds.
+*
+* The thread only looks at its type's display set. Each pass finds the due
+* alarms with one due_scan() over the set's deadlines rather than checking
+* "time(NULL) >= alarm->time" node by node along the whole alarm list.
+*
+* Passes are paced by the clock: one at the start of every second with the
+* real clock, one per turn given by clock_advance() with the simulated one.
+* A pass is skipped without taking the lock when the set's generation is the
+* one the last pass saw and the earliest deadline it found is still ahead.
+*
+* A3.4
+*/
+void *periodic_display_thread(void *arg){
+  type_set_t *set = arg; // parameter passed by the create thread call
+  volatile int64_t next = INT64_MIN; // earliest deadline after the last pass,
+  // volatile since pthread_cleanup_push() may be a setjmp()
+  unsigned int seen = 0; // generation of the set at the last pass
+
+  pthread_cleanup_push(cancel_set, set); // the set dies with the thread
+  set->hazard = hazard_acquire();
+
+  /*
+  * Loop forever, processing Type A alarms of specified message type.
+  * The alarm thread will be disintegrated when the process exits.
+  */
+
+  while (1){
+
+    clock_next_pass(&set->clock, next); // waits for the time of the next pass
+    if (__atomic_load_n(&set->generation, __ATOMIC_ACQUIRE) == seen &&
+      clock_now() < next)
+      continue; // nothing changed and nothing is due
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL); //disable cancellation
+    if (cow_mode)
+      next = snapshot_pass(set, &seen);
+    else
+      next = locked_pass(set, &seen);
+    if (!clock_is_simulated())
+      out_flush(); // what the pass printed is due now
+
+    /* used to avoid potential deadlock from thread termination
+    */
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); //enable cancellation
+    pthread_testcancel(); // set a cancellation point
+  }// End While(1)
+
+  pthread_cleanup_pop(0);
+}
+
+/*
+* qsort() order of the lines of a merged pass: by deadline, then namespace,
+* message type and message number, so a pass prints the same lines in the
+* same order every time.
+*/
+int merged_order(const void *a, const void *b){
+  const merged_line_t *x = a, *y = b;
+  int order;
+
+  if (x->deadline != y->deadline)
+    return x->deadline < y->deadline ? -1 : 1;
+  if (x->ns != y->ns && (order = strcmp(x->ns->name, y->ns->name)) != 0)
+    return order;
+  if (x->type != y->type)
+    return x->type < y->type ? -1 : 1;
+  return (x->number > y->number) - (x->number < y->number);
+}
+
+/* READER
+*
+* One pass of the merged display thread: locked_pass() over every display
+* set at once. The due alarms of all the sets are collected under the read
+* lock (the rate limit of each type is applied there too, since the set may
+* be gone once the lock is released), then sorted by the deadline they fell
+* due at and printed outside the lock.
+*
+* Stores merged_generation in "seen" and returns the earliest deadline of
+* all the sets.
+*/
+int64_t merged_pass(hazard_t *hazard, unsigned int *seen){
+  static merged_line_t *line = NULL; // the merged thread's only
+  static size_t line_size = 0;
+  type_set_t *set;
+  alarm_t *alarm;
+  size_t i, due, lines = 0;
+  time_t now;
+  int64_t next = INT64_MAX;
+  int s, timed = !clock_is_simulated();
+
+  read_lock();
+  now = clock_now();
+  for (s = 0; s < merged_count; s++){
+    set = merged_set[s];
+    print_notices(set);
+
+    due = due_scan(set->deadline, set->count, now, set->due);
+    if (lines + due > line_size){
+      line_size = lines + due > 2 * line_size ? lines + due : 2 * line_size;
+      line = realloc(line, line_size * sizeof(merged_line_t));
+      if (line == NULL)
+        errno_abort ("Allocate merged display");
+    }
+    for (i = 0; i < due; i++){ //A.3.4.1
+      alarm = set->alarm[set->due[i]];
+      if (rate_allow(set, now)){
+        hazard_protect(hazard, alarm); // printed below, outside the lock
+        line[lines].deadline = set->deadline[set->due[i]];
+        line[lines].ns = set->ns;
+        line[lines].type = alarm->type;
+        line[lines].number = alarm->number;
+        line[lines++].alarm = alarm;
+      }
+      alarm->time = now + alarm->seconds;
+      set->deadline[set->due[i]] = alarm->time;
+    }
+
+    for (i = 0; i < (size_t)set->count; i++)
+      if (set->deadline[i] < next)
+        next = set->deadline[i];
+  }
+  *seen = __atomic_load_n(&merged_generation, __ATOMIC_ACQUIRE);
+  read_unlock();
+
+  if (lines > 1)
+    qsort(line, lines, sizeof(merged_line_t), merged_order);
+  for (i = 0; i < lines; i++){
+    // PRINT MESSAGE // A.3.4.1
+    print_fired(line[i].ns, line[i].type, line[i].number, now,
+      line[i].alarm->message);
+    if (timed)
+      __atomic_add_fetch(&line[i].ns->stats.late[late_bucket(now)], 1,
+        __ATOMIC_RELAXED);
+  }
+  hazard_clear(hazard);
+  return next;
+}
+
+/* READER
+*
+* The merged display thread (-M), started by main. It paces its passes by
+* the clock like a periodic display thread, and skips a pass without taking
+* the lock when no set has changed and nothing is due. It is never
+* cancelled: terminating a type only takes its set away, see
+* merged_remove().
+*
+* A3.4
+*/
+void *merged_display_thread(void *arg){
+  hazard_t *hazard = hazard_acquire();
+  int64_t next = INT64_MIN; // earliest deadline after the last pass
+  unsigned int seen = 0; // merged_generation at the last pass
+
+  while (1){
+    clock_next_pass(&merged_clock, next);
+    if (__atomic_load_n(&merged_generation, __ATOMIC_ACQUIRE) == seen &&
+      clock_now() < next)
+      continue; // nothing changed and nothing is due
+
+    next = merged_pass(hazard, &seen);
+    if (!clock_is_simulated())
+      out_flush(); // what the pass printed is due now
+  }
+  return NULL;
+}
+
+/*WRITER
+*
+* Type A handler, called for a replacement that changed an alarm's message
+* type. If no alarm of the old type is left, its periodic display thread is
+* useless and gets terminated.
+*
+* A3.3.1
+*/
+void handle_type_a(request_t *request){
+  type_a_request_t *a = (type_a_request_t*)request;
+  namespace_t *ns = request->ns;
+
+  write_lock();
+  if (find_set(ns, a->prev_type) != NULL && check_type_a_exists(ns, a->prev_type) == 0){
+    terminate_thread(ns, a->prev_type);
+    remove_alarm_B(ns, a->prev_type); // remove it from the list
+    debug(ns);
+  }
+  write_unlock();
+  add_memory(ns, -(long)sizeof(type_a_request_t));
+  free(a);
+}
+
+/*WRITER
+*
+* Type B handler: creates a periodic display thread responsible for printing
+* messages of the specified type.
+*
+* A3.3.2
+*/
+void handle_type_b(request_t *request){
+  type_b_t *b = (type_b_t*)request;
+  namespace_t *ns = request->ns;
+  thread_t *thrd;
+  pthread_t thread;
+  int status;
+
+  write_lock();
+
+  /*
+  * A Type C processed after this request was accepted may have removed the
+  * last alarm of its type, in which case there is nothing left to display.
+  */
+  if (check_type_a_exists(ns, b->type) == 0){
+    ns_printf(ns, "Type B Alarm Request Error: No Alarm Request With Message Type"
+    "(%d)!\n", b->type);
+    remove_alarm_B(ns, b->type);
+    write_unlock();
+    return;
+  }
+
+  thrd = (thread_t*)malloc (sizeof (thread_t)); //allocate thread struct
+  if (thrd == NULL)
+    errno_abort ("Allocate Thread");
+
+  /* create a thread for periodically printing messages
+  *  pass the display set of its message type as an argument
+  */
+  thrd->set = create_set(ns, b->type);
+  if (merged_mode){
+    merged_add(thrd->set); // served by the merged display thread
+    thread = merged_thread;
+  }else{
+    clock_join(&thrd->set->clock); // before the thread exists, see alarm_clock.h
+    status = pthread_create(&thread, NULL, periodic_display_thread, thrd->set);
+    if (status != 0)
+      err_abort (status, "Create alarm thread"); // A.3.3.2 (a)
+  }
+  thrd->type = b->type; // set the attributes for the thread struct
+  thrd->thread_id = thread;
+
+  insert_thread(ns, thrd);
+
+  ns_event(ns, EVENT_CREATED, clock_now(), b->type, 0, NULL,
+  "Type B Alarm Request Processed at <%d>: New Periodic Dis"
+  "play Thread With Message Type (%d) Created.\n", (int)clock_now(),
+  b->type ); // A.3.3.2 (b)
+  debug(ns);
+  write_unlock();
+}
+
+/*WRITER
+*
+* Type C handler: removes the alarm of the message number specified by the
+* Type C request from the alarm list.
+*
+* if there are no more alarm requests in the alarm list the same type as
+* the one that was just removed, terminate the periodic display thread
+* responsible for displaying those messages.
+*
+* A3.3.3
+*/
+void handle_type_c(request_t *request){
+  type_c_t *c = (type_c_t*)request;
+  namespace_t *ns = request->ns;
+  int number = c->number;
+  int val;
+
+  write_lock();
+
+  val = remove_alarm(ns, number); // A.3.3.3 (a)
+  if(val != 0){ // A.3.3.3 (c)
+    ns_event(ns, EVENT_CANCELLED, clock_now(), val, number, NULL,
+    "Type C Alarm Request Processed at <%d>: Alarm Request"
+    " With Message Number (%d) Removed\n", (int)clock_now(), number);
+
+    if(check_type_a_exists(ns, val) == 0){ // A.3.3.3 (b)
+
+      if (find_set(ns, val) != NULL){
+        terminate_thread(ns, val); // terminate the thread
+        remove_alarm_B(ns, val); // remove the B alarm from alarm list
+      }
+
+      ns_event(ns, EVENT_TERMINATED, clock_now(), val, 0, NULL,
+      "No More Alarm Requests With Message Type (%d):"
+      " Periodic Display Thread For Message Type (%d)"
+      " Terminated.\n", val, val); // A.3.3.3 (d)
+    }
+  }
+  remove_alarm_C(ns, number);// remove alarm from the alarm list
+  debug(ns);
+
+  write_unlock();
+}
+
+/*
+* Handlers for the requests taken off the dispatch queue, by request type.
+*/
+void (*const request_handlers[])(request_t *) = {
+  [TYPE_A] = handle_type_a,
+  [TYPE_B] = handle_type_b,
+  [TYPE_C] = handle_type_c,
+};
+
+/*WRITER
+*
+* The alarm thread's start routine.
+*
+* An initial thread which is responsible for performing the requests main
+* queues for it, in the order they were accepted.
+*
+* A3.3
+*/
+void *alarm_thread (void *arg){
+  request_t *request;
+
+  /*
+  * Loop forever, processing commands. The alarm thread will
+  * be disintegrated when the process exits.
+  */
+
+  while (1){
+    request = dequeue_request(); // waits until a request is queued
+    request_handlers[request->request_type](request);
+    release_queue_slot(); // main reserved a place for every request
+    if (__atomic_sub_fetch(&requests_pending, 1, __ATOMIC_ACQ_REL) == 0 &&
+      interactive)
+      out_flush(); // caught up with the user, the replies go out together
+  }
+}
+
+/*WRITER
+* Type A request: inserts (or replaces) the alarm in the alarm list.
 *
+* A.3.2.1 - A.3.2.2
 */
-int check_useless_thread(){
-  thread_t **last, *next;
-
-  last = &thread_list;
-  next = *last;
+void accept_type_a(namespace_t *ns, command_t *cmd){
+  alarm_t *alarm;
+  type_a_request_t *request;
+  alarm_t *old;
 
   /*
-  * loop throught the thread list and check the alarm list for Type A alarms
-  * that have the same message type as the thread. if at least 1 exists, return
-  * 0.
+  * the checks and the insertion are one critical section, the alarm thread
+  * may be removing alarms at the same time. Whether a request is queued is
+  * only known inside it, so a place in the queue is reserved beforehand and
+  * given back when none is.
   */
-  while(next != NULL){
+  reserve_queue_slot();
+  write_lock();
+  old = find_alarm(ns, cmd->number);
 
-    if(check_type_a_exists(next->type) == 0){
-      terminate_thread(next->type);
-      return 1;
-    }
-    next = next->link;
+  /*
+  * a replacement does not add an alarm, but may move one to another type
+  */
+  if (old == NULL && ns->limits.max_alarms > 0 && ns->stats.alarms >= ns->limits.max_alarms){
+    ns_printf(ns, "Error: Alarm Limit (%d) Reached, Alarm Request With Message Number"
+    " (%d) Rejected!\n", ns->limits.max_alarms, cmd->number);
+    ns->stats.rejected++;
+    write_unlock();
+    release_queue_slot();
+    return;
+  }
+  if (ns->limits.max_per_type > 0 && (old == NULL || old->type != cmd->type) &&
+    type_count(ns, cmd->type) >= ns->limits.max_per_type){
+    ns_printf(ns, "Error: Alarm Limit (%d) For Message Type (%d) Reached, Alarm Request"
+    " With Message Number (%d) Rejected!\n", ns->limits.max_per_type, cmd->type,
+    cmd->number);
+    ns->stats.rejected++;
+    write_unlock();
+    release_queue_slot();
+    return;
+  }
+  if (over_memory(ns, alarm_bytes(cmd->message) + sizeof(type_a_request_t))){
+    ns_printf(ns, "Error: Memory Limit (%ld bytes) Reached, Alarm Request With Message"
+    " Number (%d) Rejected!\n", ns->limits.max_memory, cmd->number);
+    ns->stats.rejected++;
+    write_unlock();
+    release_queue_slot();
+    return;
   }
 
-  return 0;
-}
+  alarm = (alarm_t*)malloc (alarm_bytes(cmd->message));
+  if (alarm == NULL) errno_abort ("Allocate alarm");
+  alarm->seconds = cmd->seconds;
+  alarm->type = cmd->type;
+  alarm->number = cmd->number;
+  strcpy(alarm->message, cmd->message);
+  alarm->prev_type = alarm->type;
+  alarm->first = 1; // dormant, set_add() gives it its deadline
+  alarm->slot = -1; // not displayed yet
+  alarm->serial = ++alarm_serial;
+  add_memory(ns, alarm_bytes(alarm->message));
 
-/*
-* When debug mode is activated, prints out the contents of the alarm list as
-* well as the thread list. Also prints out the values for the semaphore
-* variables (during the time debug is called) used for mutual exclusion.
-*
-*/
-void debug(){
+  /*
+  * Insert the new alarm into the list of alarms, CRITICAL SECTION
+  */
+  alarm_insert (ns, alarm);
+  print_received(ns, old == NULL ? EVENT_INSERTED : EVENT_REPLACED, alarm);
+  debug(ns);
 
-  if (debug_flag){
-    display_lists();
-    printf("Ready = %d read_count = %d writing = %d\n\n", ready,
-    read_count, writing );
+  /*
+  * a replacement that changed the type may have left a useless display
+  * thread behind, which the alarm thread checks for. A.3.3.1
+  */
+  if (alarm->prev_type != alarm->type){
+    request = (type_a_request_t*)malloc (sizeof (type_a_request_t));
+    if (request == NULL) errno_abort ("Allocate request");
+    add_memory(ns, sizeof(type_a_request_t));
+    request->prev_type = alarm->prev_type;
+    enqueue_request(ns, &request->request, TYPE_A);
+    write_unlock();
+  }else{
+    write_unlock();
+    release_queue_slot(); // nothing queued
   }
-
 }
-/***************************END HELPER CODE***************************//////////
-
 
-/* READER
-*
-* TYPE B CREATED THREAD (periodic display thread).
-* responsible for periodically looking up a Type A alarm request with a
-* Message Type in the alarm list, then printing, every Time seconds.
+/*WRITER
+* Type B request: queues the creation of a periodic display thread.
+* Does not allow for duplicate type B requests.
+* Only accepted if there exists a type A alarm of type B's Message Type.
 *
-* A3.4
+* A.3.2.3 - A.3.2.5
 */
-void *periodic_display_thread(void *arg){
-  alarm_t *alarm = alarm_list;
-  int status, flag;
-
-  int *arg_pointer = arg;
-  int type = *arg_pointer; // parameter passed by the create thread call
-
-  /*
-  * Loop forever, processing Type A alarms of specified message type.
-  * The alarm thread will be disintegrated when the process exits.
-  */
+void accept_type_b(namespace_t *ns, command_t *cmd){
+  type_b_t *b;
+  int admitted = 0;
+  registry_t *registry = read_registry(ns); // no lock needed, see the registry
 
-  while (1){
+  if(check_type_a_exists(ns, cmd->type) == 0){ // A.3.2.3
 
-    while(ready > 0){
-      // wrtiter is ready to trite so don't do anything
-    }
+    ns_printf(ns, "Type B Alarm Request Error: No Alarm Request With Message Type"
+    "(%d)!\n", cmd->type);
 
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL); //disable cancellation
-    while (alarm_list == NULL){
-      ///// ACHTUNG! /////
-      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); //enable cancellation
-      pthread_testcancel();
-    }
+  }else if(check_dup(registry, cmd->type) == 1){ // A.3.2.4
 
-    /////
-    if (flag == 1){
-      alarm = alarm_list; // go back to the beginning
-      flag = 0;
-    }
-    if (alarm->link == NULL){
-      flag = 1; // go back to the beginning of the list
-    }
-    /////
-    sem_wait(&sem_mutex);
-    read_count++;
-    sem_post(&sem_mutex);
+    ns_printf(ns, "Error: More Than One Type B Alarm Request With"
+      " Message Type (%d)!\n", cmd->type );
 
-    if(alarm->type != type && alarm->request_type == TYPE_A){ //A.3.4.2
-      /*
-      * check if its type has changed. if its type has changed from a different
-      * one, notify the user that an alarm with the specified type which
-      * previously had a different type has been assigned.
-      */
-      if(check_prev(alarm) == 1 && alarm->prev_type == type){
-        if(alarm->expo == 0){ // check if alarm change has been acknowledged
-          printf("Alarm With Message Type (%d) Replaced at <%d>: "
-          "<Type A>\n", alarm->type, (int)time(NULL)); // A.3.4.2
-          alarm->expo = 1; // alarm exposed (change acknowledged)
-        }
-      }
-    }
+  }else if(ns->limits.max_workers > 0 && registry != NULL &&
+    registry->count >= ns->limits.max_workers){
 
+    ns_printf(ns, "Error: Display Thread Limit (%d) Reached, Type B Alarm Request With"
+      " Message Type (%d) Rejected!\n", ns->limits.max_workers, cmd->type);
+    ns->stats.rejected++;
 
-  	if (alarm->type == type && alarm->request_type == TYPE_A && alarm->first == 1){
-  		alarm->time = time (NULL) + alarm->seconds;
-      alarm->first = 0;
-  	}
+  }else if(over_memory(ns, sizeof(type_b_t))){
 
-    if(alarm->type == type && alarm->request_type == TYPE_A && time(NULL) >= alarm->time){ //A.3.4.1
-      // PRINT MESSAGE // A.3.4.1
-      printf("Alarm With Message Type (%d) and Message Number"
-      " (%d) Displayed at <%d>: <Type A> : ",
-      alarm->type, alarm->number, (int)time(NULL) );
-      printf ("\"%s\"\n", alarm->message);
-      alarm->time = time (NULL) + alarm->seconds;
-    }
-	  alarm = alarm->link; // go to the next node on the list
+    ns_printf(ns, "Error: Memory Limit (%ld bytes) Reached, Type B Alarm Request With"
+      " Message Type (%d) Rejected!\n", ns->limits.max_memory, cmd->type);
+    ns->stats.rejected++;
 
-    sem_wait(&sem_mutex);
-    read_count--;
-    sem_post(&sem_mutex);
+  }else{ //A.3.2.5
+    admitted = 1;
+  }
 
-    /* used to avoid potential deadlock from thread termination
-    */
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); //enable cancellation
-    pthread_testcancel(); // set a cancellation point
-  }// End While(1)
+  if (admitted){
+    b = (type_b_t*)malloc (sizeof (type_b_t));
+    if (b == NULL) errno_abort ("Allocate Type B request");
+    b->type = cmd->type;
+    add_memory(ns, sizeof(type_b_t));
+
+    reserve_queue_slot();
+    write_lock();
+    insert_type_b(ns, b);
+    ns_printf(ns, "Type B Create Thread Alarm Request With Message Type (%d)"
+    " Inserted Into Alarm List at <%d>!\n", b->type, (int)clock_now());
+    enqueue_request(ns, &b->request, TYPE_B);
+    write_unlock();
+  }
 }
 
 /*WRITER
+* Type C request: queues the cancellation of a Type A alarm.
+* Does not allow for duplicate type C requests.
+* Only accepted if there exists a type A alarm of type C's Message Number.
 *
-* The alarm thread's start routine.
-*
-* An initial thread which is responsible for looping through the
-* alarm list and checking the status of each type A alarm, as well as performing
-* type B or C requests as they are inserted.
-*
-* A3.3
+* A.3.2.6 - A.3.2.8
 */
-void *alarm_thread (void *arg){
+void accept_type_c(namespace_t *ns, command_t *cmd){
+  type_c_t *c;
+  int admitted = 0;
 
-  alarm_t **last, *next;
-  int status;
+  read_lock(); // the alarm thread may be changing the lists
+  if (check_number_a_exists(ns, cmd->number) == 0){ // A.3.2.6
 
-  /*
-  * Loop forever, processing commands. The alarm thread will
-  * be disintegrated when the process exits.
-  */
+    ns_printf(ns, "Error: No Alarm Request With Message"
+      " Number (%d) to Cancel!\n", cmd->number );
 
-  while (1){
+  }else if (check_dup_2(ns, cmd->number) == 1){ // A.3.2.7
 
-    /*
-    * If a new alarm hasnt been added, wait until a new alarm is
-    * added
-    */
+    ns_printf(ns, "Error: More Than One Request to Cancel Alarm Request With"
+      " Message Number (%d)!\n", cmd->number);
 
-     while (insert_flag == 0) {
-       //busy wait
-     }
+  }else if (over_memory(ns, sizeof(type_c_t))){
+
+    ns_printf(ns, "Error: Memory Limit (%ld bytes) Reached, Type C Alarm Request With"
+      " Message Number (%d) Rejected!\n", ns->limits.max_memory, cmd->number);
+    ns->stats.rejected++;
+
+  }else{ // A.3.2.8
+    admitted = 1;
+  }
+  read_unlock();
+
+  if (admitted){
+    c = (type_c_t*)malloc (sizeof (type_c_t));
+    if (c == NULL) errno_abort ("Allocate Type C request");
+    c->number = cmd->number;
+    add_memory(ns, sizeof(type_c_t));
+
+    reserve_queue_slot();
+    write_lock();
+    insert_type_c(ns, c);
+    ns_printf(ns, "Type C Cancel Alarm Request With Message Number (%d)"
+      " Inserted Into Alarm List at <%d>: <Type C>\n", c->number,
+          (int)clock_now());
+    enqueue_request(ns, &c->request, TYPE_C);
+    write_unlock();
+  }
+}
+
+/*
+* "debug" command: toggles debug mode
+*/
+void toggle_debug(namespace_t *ns, command_t *cmd){
+  if (debug_flag == 0){
+    out_printf("**DEBUG MODE ENGAGED**\n");
+    debug_flag = 1;
+  }else{
+    out_printf("**DEBUG MODE DISENGAGED**\n");
+    debug_flag = 0;
+  }
+}
 
+/*
+* "stats" command: prints the admission counters and limits
+*/
+void print_stats(namespace_t *ns, command_t *cmd){
+  thread_t *thread;
+  long suppressed;
+  replica_lag_t lag;
+  int queued;
+
+  sem_getvalue(&queue_slots, &queued);
+  read_lock(); // the alarm thread updates the counters
+  ns_printf(ns, "[Stats: alarms = %d/%d display threads = %d/%d memory = %ld/%ld bytes"
+  " queued = %d/%d rejected = %ld queue full = %ld retired = %ld]\n", ns->stats.alarms,
+  ns->limits.max_alarms, ns->registry != NULL ? ns->registry->count : 0,
+  ns->limits.max_workers,
+  __atomic_load_n(&ns->stats.memory, __ATOMIC_RELAXED), ns->limits.max_memory,
+  max_queue + __atomic_load_n(&slots_to_retire, __ATOMIC_RELAXED) - queued, max_queue, ns->stats.rejected, queue_full, hazard_retired());
+  if (cow_mode)
+    ns_printf(ns, "[Snapshots: published = %ld copied = %ld bytes (%.0f per change)]\n",
+    cow_versions, cow_bytes, cow_versions > 0 ? (double)cow_bytes / cow_versions : 0.0);
+  if (rate_limit > 0){
+    ns_printf(ns, "[Rate limit: %g lines/s burst = %g suppressed = %ld]\n", rate_limit,
+    rate_burst, __atomic_load_n(&ns->stats.suppressed, __ATOMIC_RELAXED));
     /*
-    * when a new alarm has been inserted, loop through the alarm list and find
-    * and process the alarm
+    * a set lives as long as its thread is in the list, and the list does not
+    * change while the read lock is held
     */
-    last = &alarm_list;
-    next = *last;
+    for (thread = ns->thread_list; thread != NULL; thread = thread->link)
+      if ((suppressed = __atomic_load_n(&thread->set->suppressed, __ATOMIC_RELAXED)) > 0)
+        ns_printf(ns, "[Rate limit: Message Type (%d) suppressed = %ld]\n",
+        thread->type, suppressed);
+  }
+  if (!clock_is_simulated())
+    ns_printf(ns, "[Lateness: <1ms = %ld <10ms = %ld <100ms = %ld <1s = %ld >=1s = %ld]\n",
+    __atomic_load_n(&ns->stats.late[0], __ATOMIC_RELAXED),
+    __atomic_load_n(&ns->stats.late[1], __ATOMIC_RELAXED),
+    __atomic_load_n(&ns->stats.late[2], __ATOMIC_RELAXED),
+    __atomic_load_n(&ns->stats.late[3], __ATOMIC_RELAXED),
+    __atomic_load_n(&ns->stats.late[4], __ATOMIC_RELAXED));
+  if (primary_path != NULL)
+    ns_printf(ns, "[Replication: primary standby = %s lines sent = %ld]\n",
+    replica_on ? "connected" : "none", replica_sent());
+  if (standby_path != NULL){
+    replica_lag(&lag);
+    ns_printf(ns, "[Replication: standby lines received = %ld lag average = %.0f us"
+    " max = %.0f us]\n", lag.lines, lag.average, lag.max);
+  }
+  if (ns->stats.activations > 0)
+    ns_printf(ns, "[Activation: display sets = %ld alarms = %ld time = %.0f us"
+    " (%.0f ns per alarm)]\n", ns->stats.activations, ns->stats.activated,
+    ns->stats.activation_ns / 1e3, ns->stats.activated > 0 ?
+    (double)ns->stats.activation_ns / ns->stats.activated : 0.0);
+  ns_printf(ns, "[I/O: backend = %s sink = %s system calls = %ld]\n",
+    io_backend_name(), out_sink_name(), io_syscalls());
+  read_unlock();
+}
 
-    while(next != NULL){
+/*
+* Settings that can be changed while the program runs with
+* "set <name> <value>", or given in a configuration file with -c (one
+* "<name> <value>" per line, '#' starting a comment). "set" alone prints
+* them. The limits are those of the namespace the command comes from; the
+* configuration file sets those every namespace starts with.
+*/
+#define SET_MAX_ALARMS   0
+#define SET_MAX_PER_TYPE 1
+#define SET_MAX_WORKERS  2
+#define SET_MAX_MEMORY   3
+#define SET_MAX_QUEUE    4
+#define SET_RATE         5
+#define SET_BURST        6
+#define SET_JITTER       7
+#define SET_DEBUG        8
+#define SET_INPUT_BLOCK  9
+#define SET_OUTPUT_BLOCK 10
+#define SET_QUOTAS       4 // the settings before this one are per namespace
+
+const char *const setting_names[] = {
+  [SET_MAX_ALARMS] = "max_alarms", [SET_MAX_PER_TYPE] = "max_per_type",
+  [SET_MAX_WORKERS] = "max_workers", [SET_MAX_MEMORY] = "max_memory",
+  [SET_MAX_QUEUE] = "max_queue", [SET_RATE] = "rate", [SET_BURST] = "burst",
+  [SET_JITTER] = "jitter", [SET_DEBUG] = "debug",
+  [SET_INPUT_BLOCK] = "input_block", [SET_OUTPUT_BLOCK] = "output_block",
+};
+#define SETTINGS (int)(sizeof(setting_names) / sizeof(setting_names[0]))
 
-      /*
-      * upon finding a new type A alarm, checks if there exists a useless
-      * periodic display thread and terminates it if such thread exists.
-      */
-      if(next->request_type == TYPE_A){ // A.3.3.1
-        if(next->is_new == 1){
-          next->is_new = 0; // alarm is no longer new
-
-          status = check_useless_thread(); // remove possible useless threads
-          if (status == 1){ // then remove it from the alarm list
-            ////////////////
-            ready++; // the writer is ready to use the alarm list
-            while(read_count > 0 || writing > 0){
-              // busy waits for readers to be done
-            }
-            status = sem_wait(&rw_sem);
-            if(status != 0)
-              err_abort(status, "rw_sem wait");
-            writing++; // writer has control of the data structure
-            /* critical section */
-
-            remove_alarm_B(next->prev_type); // remove it from the list
-            debug();
-            writing--;
-            status = sem_post(&rw_sem);
-            if(status != 0)
-              err_abort(status, "rw_sem post");
-            ready--;
-            ////////////////
-          }else{
-            debug();
-          }
-          break;
-        }
-      }// END TYPE A ***************************///////
+/*
+* returns the setting called "name", or -1 if there is none
+*/
+int find_setting(const char *name){
+  int i;
 
-      /*
-      * upon finding a new type B alarm, creates a periodic display thread
-      * responsible for printing messages its specified type
-      */
-      else if(next->request_type == TYPE_B){ // A.3.3.2
-        if(next->is_new == 1){
-
-          next->is_new = 0; // alarm is no longer new
-          thread_t *thrd;
-          pthread_t thread;
-
-
-          thrd = (thread_t*)malloc (sizeof (thread_t)); //allocate thread struct
-          if (thrd == NULL)
-          errno_abort ("Allocate Thread");
-
-          /* create a thread for periodically printing messages
-          *  pass message type as an argument
-          */
-          status = pthread_create(&thread, NULL, periodic_display_thread,
-          &next->type);
-          if (status != 0)
-            err_abort (status, "Create alarm thread"); // A.3.3.2 (a)
-          thrd->type = next->type; // set the attributes for the thread struct
-          thrd->thread_id = thread;
-
-          insert_thread(thrd);
-
-          printf("Type B Alarm Request Processed at <%d>: New Periodic Dis"
-          "play Thread With Message Type (%d) Created.\n", (int)(time(NULL)),
-          next->type ); // A.3.3.2 (b)
-          debug();
-          break;
-        }
-      }// END TYPE B ***************************///////
+  for (i = 0; i < SETTINGS; i++)
+    if (strcmp(name, setting_names[i]) == 0)
+      return i;
+  return -1;
+}
 
+/*
+* Returns the value of a setting. "limit" holds the limits to report.
+*/
+double get_setting(limits_t *limit, int setting){
+  switch (setting){
+    case SET_MAX_ALARMS: return limit->max_alarms;
+    case SET_MAX_PER_TYPE: return limit->max_per_type;
+    case SET_MAX_WORKERS: return limit->max_workers;
+    case SET_MAX_MEMORY: return limit->max_memory;
+    case SET_MAX_QUEUE: return max_queue;
+    case SET_RATE: return rate_limit;
+    case SET_BURST: return rate_burst;
+    case SET_JITTER: return jitter;
+    case SET_DEBUG: return debug_flag;
+    case SET_INPUT_BLOCK: return input_block;
+    default: return out_get_block();
+  }
+}
+
+/*
+* Changes a setting. Returns 0, and changes nothing, if the value is out of
+* range. "limit" holds the limits to change. "running" is 0 while the
+* configuration file is read, before the dispatch queue exists.
+*
+* Requires the caller to be a writer of the alarm list once running.
+*/
+int put_setting(limits_t *limit, int setting, double value, int running){
+  long whole = (long)value;
+
+  if (value != whole && setting != SET_RATE && setting != SET_BURST)
+    return 0; // only the rate limit takes fractions
+  switch (setting){
+    case SET_MAX_ALARMS: case SET_MAX_PER_TYPE: case SET_MAX_WORKERS:
+      if (whole < 0 || whole > INT_MAX)
+        return 0;
+      if (setting == SET_MAX_ALARMS)
+        limit->max_alarms = whole;
+      else if (setting == SET_MAX_PER_TYPE)
+        limit->max_per_type = whole;
+      else
+        limit->max_workers = whole;
+      return 1;
+    case SET_MAX_MEMORY:
+      if (whole < 0)
+        return 0;
+      limit->max_memory = whole;
+      return 1;
+    case SET_MAX_QUEUE:
+      if (whole <= 0 || whole > INT_MAX)
+        return 0;
+      if (!running){
+        max_queue = whole;
+        return 1;
+      }
       /*
-      * upon finding a new type C alarm, removes the alarm of the message
-      * number specified by the Type C alarm from the alarm list.
-      *
-      * if there are no more alarm requests in the alarm list the same type as
-      * the one that was just removed, terminate the periodic display thread
-      * responsible for displaying those messages.
-      *
-      * This is the only part of the  alarm thread that writes to the alarm list
+      * Only main takes slots, so it can resize the queue: new slots are
+      * posted, removed ones are taken if they are free and otherwise
+      * retired by the alarm thread once it is done with their requests.
+      * Waiting for them here would deadlock, the alarm thread needs the
+      * write lock to get there.
       */
-      else if(next->request_type == TYPE_C){ //A.3.3.3
-        int val;
-        if(next->is_new == 1){
-          next->is_new == 0; // alarm is no longer new
-
-
-          ready++; // the writer is ready to use the alarm list
-          while(read_count > 0 || writing > 0){
-            // busy waits for readers to be done
-          }
-          status = sem_wait(&rw_sem);
-          if(status != 0)
-            err_abort(status, "rw_sem wait");
-          writing++; // writer has control of the data structure
+      for (; max_queue < whole; max_queue++)
+        release_queue_slot();
+      for (; max_queue > whole; max_queue--)
+        if (sem_trywait(&queue_slots) != 0)
+          __atomic_add_fetch(&slots_to_retire, 1, __ATOMIC_RELAXED);
+      return 1;
+    case SET_RATE: case SET_BURST:
+      if (value < 0 || (setting == SET_BURST && value < 1))
+        return 0;
+      if (setting == SET_RATE){
+        __atomic_store(&rate_limit, &value, __ATOMIC_RELAXED);
+        if (rate_burst < 1) // -L was not given, the burst defaults to the rate
+          __atomic_store(&rate_burst, &value, __ATOMIC_RELAXED);
+      }else{
+        __atomic_store(&rate_burst, &value, __ATOMIC_RELAXED);
+      }
+      return 1;
+    case SET_JITTER: case SET_DEBUG:
+      if (whole != 0 && whole != 1)
+        return 0;
+      if (setting == SET_JITTER)
+        jitter = whole;
+      else
+        debug_flag = whole;
+      return 1;
+    case SET_INPUT_BLOCK:
+      if (whole < 1 || whole > INPUT_BLOCK)
+        return 0;
+      input_block = whole; // from the next read on
+      return 1;
+    default:
+      if (whole < 1 || whole > OUT_BLOCK)
+        return 0;
+      out_set_block(whole);
+      return 1;
+  }
+}
 
+/*
+* "set [<name> <value>]" command: changes a setting (see put_setting()) or
+* prints them all. The alarm thread and the display threads go on.
+*/
+void set_command(namespace_t *ns, command_t *cmd){
+  char name[32];
+  double value;
+  int setting, i;
+
+  if (cmd->message[0] == '\0'){
+    read_lock();
+    for (i = 0; i < SETTINGS; i++)
+      ns_printf(ns, "[Set: %s = %g]\n", setting_names[i],
+      get_setting(&ns->limits, i));
+    read_unlock();
+    return;
+  }
+  if (sscanf(cmd->message, "%31s %lf", name, &value) != 2){
+    ns_printf(ns, "Error: set Needs A Name And A Value!\n");
+    return;
+  }
+  if ((setting = find_setting(name)) < 0){
+    ns_printf(ns, "Error: Unknown Setting (%s)!\n", name);
+    return;
+  }
+  write_lock();
+  if (put_setting(&ns->limits, setting, value, 1))
+    ns_printf(ns, "[Set: %s = %g]\n", name, get_setting(&ns->limits, setting));
+  else
+    ns_printf(ns, "Error: Value (%g) Out Of Range For Setting (%s)!\n", value, name);
+  write_unlock();
+}
 
-          val = remove_alarm(next->number); // A.3.3.3 (a)
-          if(val != 0){ // A.3.3.3 (c)
+/*
+* Reads the configuration file given with -c, see put_setting(). Exits on
+* an error, since the program would not run the way it was configured.
+*/
+void read_config(const char *path){
+  FILE *file;
+  char line[256], name[32], *p;
+  double value;
+  int number = 0, setting;
+
+  if ((file = fopen(path, "r")) == NULL)
+    errno_abort ("Open configuration file");
+  while (fgets(line, sizeof(line), file) != NULL){
+    number++;
+    if ((p = strchr(line, '#')) != NULL)
+      *p = '\0';
+    if (sscanf(line, "%31s", name) != 1)
+      continue; // a blank line
+    if (sscanf(line, "%31s %lf", name, &value) != 2 ||
+      (setting = find_setting(name)) < 0 || !put_setting(&limits, setting, value, 0)){
+      fprintf(stderr, "%s:%d: bad setting: %s", path, number, line);
+      exit(1);
+    }
+  }
+  fclose(file);
+}
 
-            remove_alarm_C(next->number);// remove alarm from the alarm list
-            printf("Type C Alarm Request Processed at <%d>: Alarm Request"
-            " With Message Number (%d) Removed\n", (int)(time(NULL)),
-            next->number);
-          }
+/*
+* "advance <seconds>" command: moves the simulated clock forward once the
+* alarm thread has handled everything queued before it, so that the display
+* threads it created take part in the advance.
+*/
+void advance_clock(namespace_t *ns, command_t *cmd){
+  if (!clock_is_simulated()){
+    fprintf (stderr, "Error: advance Needs The Simulated Clock (-S)\n");
+    return;
+  }
+  wait_for_alarm_thread();
+  clock_advance(cmd->seconds);
+  ns_printf(ns, "Clock Advanced to <%d>\n", (int)clock_now());
+}
 
-          if(check_type_a_exists(val) == 0){ // A.3.3.3 (b)
+void bad_command(namespace_t *ns, command_t *cmd){
+  fprintf (stderr, "Bad command\n");
+}
 
-            terminate_thread(val); // terminate the thread
-            remove_alarm_B(val); // remove the B alarm from alarm list
-            remove_alarm_C(next->number);// remove alarm from the alarm list
+/*
+* Handlers for the parsed input lines, by command kind.
+*/
+void (*const command_handlers[])(namespace_t *, command_t *) = {
+  [CMD_BAD] = bad_command,
+  [CMD_TYPE_A] = accept_type_a,
+  [CMD_TYPE_B] = accept_type_b,
+  [CMD_TYPE_C] = accept_type_c,
+  [CMD_DEBUG] = toggle_debug,
+  [CMD_STATS] = print_stats,
+  [CMD_ADVANCE] = advance_clock,
+  [CMD_SET] = set_command,
+};
 
-            printf("No More Alarm Requests With Message Type (%d):"
-            " Periodic Display Thread For Message Type (%d)"
-            " Terminated.\n", val, val); // A.3.3.3 (d)
+/*
+* Appends an input line to the record file, stamped with the time since the
+* program started.
+*/
+void record_line(const char *line, size_t len){
+  struct timespec now;
+  long sec, nsec;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  sec = now.tv_sec - record_start.tv_sec;
+  nsec = now.tv_nsec - record_start.tv_nsec;
+  if (nsec < 0){
+    sec--;
+    nsec += 1000000000L;
+  }
+  fprintf(record_file, "%ld.%09ld %.*s\n", sec, nsec, (int)len, line);
+}
 
-          }debug();
+/*
+* Hands a parsed command to its handler.
+*/
+void process_command(namespace_t *ns, command_t *cmd){
+  command_handlers[cmd->kind](ns, cmd);
 
-          writing--;
-          status = sem_post(&rw_sem);
-          if(status != 0)
-            err_abort(status, "rw_sem post");
-          ready--;
-        }
-        break;
-      }// END TYPE C ***************************///////
-      next = next->link; //go to the next node
-    } // End list loop
-    insert_flag = 0; // finished looping and processd new alarm
-  }
+  /*
+  * with the simulated clock, every request is handled before the next one
+  * is read, so that a run never depends on how the threads were scheduled
+  */
+  if (clock_is_simulated())
+    wait_for_alarm_thread();
 }
 
 /*WRITER
 * Parses inputs as specified in assaignment 3 outline
 *
-* Creates 3 different alarm requests (Type A - C) and inserts them into the
-* alarm list. THe alarm thread then processes these alarm requests as they already
-* inserted
+* Creates 3 different alarm requests (Type A - C). Type A alarms go straight
+* into the alarm list, the others are queued for the alarm thread.
+*
+* "line" holds "len" characters, without the newline.
 */
-int main (int argc, char *argv[]){
-  int status;
-  char line[128];
-  char deb[8];
-  alarm_t *alarm;
-  thread_t *thrd;
-  pthread_t thread;
-
-  status = sem_init(&rw_sem, 0, 1); // initialize reader writer Semaphore
-  if(status != 0)
-    err_abort(status, "Create READ-WRITE Semaphore");
+void process_line(const char *line, size_t len){
+  command_t cmd;
+  namespace_t *ns = namespace_list; // the default namespace
+  const char *name, *end = line + len;
 
-  status = sem_init(&sem_mutex, 0, 1); // initialize reader writer Semaphore
-  if(status != 0)
-    err_abort(status, "Create Mutex Semaphore");
+  if (record_file != NULL)
+    record_line(line, len);
+  if (replica_on)
+    replica_send(line, len);
 
   /*
-  * Create the initial thread responsible for looping through the alarm list
-  * and performing operations depening on the request type
-  *
-  * leaving the argument "NULL" would also imply that the initial thread
+  * "@name " in front of a request sends it to that namespace
   */
-  status = pthread_create (&thread, NULL, alarm_thread, NULL);
-  if (status != 0) err_abort (status, "Create alarm thread");
+  if (len > 1 && line[0] == '@'){
+    for (name = ++line; line < end && *line != ' ' && *line != '\t'; line++)
+      ;
+    ns = find_namespace(name, line - name);
+    while (line < end && (*line == ' ' || *line == '\t'))
+      line++;
+    len = end - line;
+  }
 
-  while (1) {
-    printf ("alarm> ");
-    if (fgets (line, sizeof (line), stdin) == NULL) exit (0);
-    if (strlen (line) <= 1) continue;
-    alarm = (alarm_t*)malloc (sizeof (alarm_t));
-    if (alarm == NULL) errno_abort ("Allocate alarm");
+  /*
+  * Parse input line into seconds, message type, message number and a
+  * message of up to 127 characters separated from the numbers by
+  * whitespace.
+  */
+  parse_command(line, len, &cmd);
+  process_command(ns, &cmd);
+}
 
-    /*
-    * Parse input line into seconds (%d) and a message
-    * (%64[^\n]), consisting of up to 64 characters
-    * separated from the seconds by whitespace.
-    *
-    * Checks what type of alarm / message is being entered.
-    *
-    */
-    /*************************TYPE A*************************/
-    if (sscanf (line, "%d Message(%d, %d) %128[^\n]",
-    &alarm->seconds, &alarm->type, &alarm->number, alarm->message) == 4 &&
-    alarm->seconds > 0 && alarm->number > 0 && alarm->type > 0){ // A.3.2.1
-
-      alarm->time = time (NULL) + alarm->seconds;
-      alarm->request_type = TYPE_A;
-      alarm->is_new = 1;
-      alarm->prev_type = alarm->type;
-      alarm->first = 1;
-
-      ready++; // the writer is ready to use the alarm list
-      while(read_count > 0 || writing > 0){
-        // wait for readers or writers to finish
-      }
-      status = sem_wait(&rw_sem);
-      if(status != 0)
-        err_abort(status, "rw_sem wait");
-      writing++; // writer has control of the data structure
-      /*
-      * Insert the new alarm into the list of alarms, CRITICAL SECTION
-      */
-      alarm_insert (alarm);
-      printf("Type A Alarm Request With Message Number <%d> Received at"
-      " time <%d>: <Type A>\n", alarm->number, (int)time(NULL));
+/*
+* Sends the standby one "set" line for each of the settings from "first" up
+* to "last" (excluded), as they are for the namespace "ns".
+*/
+void send_settings(namespace_t *ns, int first, int last){
+  char line[NAME_SIZE + 64], *p = start_line(line, ns);
+  int i;
 
-      insert_flag = 1; // a new alarm has been inserted
+  for (i = first; i < last; i++)
+    replica_send(line, p - line + snprintf(p, line + sizeof(line) - p,
+      "set %s %.17g", setting_names[i], get_setting(&ns->limits, i)));
+}
 
-      writing--;
-      status = sem_post(&rw_sem);
-      if(status != 0)
-        err_abort(status, "rw_sem post");
-      ready--;
+/*
+* Primary (-P): sends a new standby the current state as input lines: the
+* settings every namespace shares, then for each namespace its Type A
+* alarms, its display threads and its own quotas. The quotas come last, as
+* a quota lowered after the alarms were accepted would otherwise reject
+* some of them on the standby. Called by the replication thread while main
+* is between requests; the alarm thread is let finish first, so that the
+* lines main sends next follow on. The alarms start a new period on the
+* standby.
+*/
+void send_state(){
+  namespace_t *ns;
+  alarm_t *alarm;
+  thread_t *thread;
+  char line[NAME_SIZE + MESSAGE_SIZE + 64], *p;
+
+  wait_for_alarm_thread();
+  read_lock();
+  send_settings(namespace_list, SET_QUOTAS, SETTINGS);
+  for (ns = namespace_list; ns != NULL; ns = ns->link){
+    p = start_line(line, ns);
+    for (alarm = ns->alarm_list; alarm != NULL; alarm = alarm->link)
+      replica_send(line, p - line + snprintf(p, line + sizeof(line) - p,
+        "%d Message(%d, %d) %s", alarm->seconds, alarm->type, alarm->number,
+        alarm->message));
+    for (thread = ns->thread_list; thread != NULL; thread = thread->link)
+      replica_send(line, p - line + snprintf(p, line + sizeof(line) - p,
+        "Create_Thread: MessageType(%d)", thread->type));
+    send_settings(ns, 0, SET_QUOTAS);
+  }
+  read_unlock();
+}
 
+/*
+* Standby (-Y): handles the lines the primary sends, with the output muted,
+* until the connection ends because the primary is gone. Then the output is
+* unmuted and main goes on with its own input. Display threads keep making
+* their passes while muted, so the alarms fire on time right after the
+* takeover.
+*/
+void follow_primary(int fd){
+  static char buf[2 * REPLICA_BLOCK];
+  struct timespec lost, ready;
+  replica_lag_t lag;
+  size_t have = 0, len;
+  ssize_t got;
+  const char *p, *end, *nl, *text;
+
+  out_mute(1);
+  while ((got = read(fd, buf + have, REPLICA_BLOCK)) != 0){
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got < 0)
+      break; // the primary is gone all the same
+    have += got;
+    p = buf;
+    end = buf + have;
+    while ((nl = find_line_end(p, end)) != end){
+      len = nl - p;
+      if ((text = replica_line(p, &len)) != NULL){
+        replica_lock();
+        process_line(text, len);
+        replica_unlock();
+      }
+      p = nl + 1;
     }
-    /*********************END TYPE A*************************/
-    /*************************TYPE B*************************/
-    else if (sscanf(line,"Create_Thread: MessageType(%d)",&alarm->type) == 1
-    && alarm->type > 0){ // A.3.2.3 - A.3.2.5
-
-      int exists = check_type_a_exists(alarm->type);
-      int dup = check_dup(alarm->type, TYPE_B);
-      /*
-      * Creates a Type B alarm that is then inserted into the alarm list.
-      * Does not allow for duplicate type B alarms.
-      * Only creates one if there exists a type A alarm of type B's
-      * Message Type.
-      */
+    have = end - p;
+    memmove(buf, p, have);
+    if (record_file != NULL)
+      fflush(record_file);
+    replica_lock();
+    replica_flush(); // to this standby's own standby
+    replica_unlock();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &lost);
+  close(fd);
+  out_mute(0);
+  clock_gettime(CLOCK_MONOTONIC, &ready);
+
+  replica_lag(&lag);
+  fprintf(stderr, "Primary lost, standby took over in %.0f us (%ld lines"
+    " received, lag average %.0f us, max %.0f us)\n",
+    (ready.tv_sec - lost.tv_sec) * 1e6 + (ready.tv_nsec - lost.tv_nsec) / 1e3,
+    lag.lines, lag.average, lag.max);
+}
 
-      if(exists == 0){ // A.3.2.3
+/*
+* Ring ingestion (-i path): commands come ready made from producers on the
+* same host through the shared memory ring, see cmd_ring.h. Each one is
+* copied out of its slot and handled, and the output is flushed whenever the
+* ring runs empty.
+*/
+void ingest_ring(cmd_reader_t *reader){
+  cmd_slot_t slot; // a3's own copy, see cmd_ring_poll()
 
-        printf("Type B Alarm Request Error: No Alarm Request With Message Type"
-        "(%d)!\n", alarm->type);
-        free(alarm); // deallocate alarm that isn't used
+  while (1){
+    if (!cmd_ring_poll(reader, &slot)){
+      out_flush(); // the replies to what came so far
+      if (!cmd_ring_wait(reader))
+        break; // closed by a producer
+      continue;
+    }
+    replica_lock(); // ring requests are not replicated, but change the state
+    process_command(find_namespace(slot.name, strlen(slot.name)),
+      &slot.command);
+    replica_unlock();
+  }
+}
 
-      }else if(dup == 1){ // A.3.2.4
-        // May need to fix as there is confusion between "Number" and "Type"
-        printf("Error: More Than One Type B Alarm Request With"
-          " Message Type (%d)!\n", alarm->type );
-        free(alarm); // deallocate alarm that isn't used
+/*
+* Batch ingestion, used when stdin is a pipe or a file rather than a terminal.
+* Input is read in large blocks and split into lines in place, so there is one
+* read() per block instead of one fgets() per line, and no prompt is printed.
+* With io_uring, the next block is being read while this one is processed.
+*/
+void ingest_batch(){
+  static char buf[2 * INPUT_BLOCK], ahead[INPUT_BLOCK];
+  size_t have = 0;
+  ssize_t got;
+  const char *p, *end, *nl;
+
+  io_read_start(STDIN_FILENO, ahead, sizeof(ahead));
+  while ((got = io_read_finish()) > 0){
+    replica_lock();
+    memcpy(buf + have, ahead, got);
+    have += got;
+    io_read_start(STDIN_FILENO, ahead, input_block);
+    p = buf;
+    end = buf + have;
+    while ((nl = find_line_end(p, end)) != end){
+      if (nl > p)
+        process_line(p, nl - p);
+      p = nl + 1;
+    }
 
-      }else if(exists == 1 && dup == 0){ //A.3.2.5
+    /*
+    * keep the unfinished last line for the next block. A line longer than the
+    * whole block is processed as it is.
+    */
+    have = end - p;
+    memmove(buf, p, have);
+    if (have >= INPUT_BLOCK){
+      process_line(buf, have);
+      have = 0;
+    }
+    if (record_file != NULL)
+      fflush(record_file);
+    replica_flush();
+    replica_unlock();
+    out_flush(); // the replies to this block
+  }
+  if (got < 0)
+    errno_abort ("Read input");
+  replica_lock();
+  if (have > 0)
+    process_line(buf, have);
+  replica_flush();
+  replica_unlock();
+}
 
-        alarm->request_type = TYPE_B;
-        alarm->is_new = 1;
+/*
+* prints the command line options and exits
+*/
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-a max_alarms] [-t max_alarms_per_type]"
+  " [-w max_display_threads] [-m max_memory_bytes] [-q max_queued_requests]"
+  " [-R record_file] [-S start_time] [-C] [-I uring|plain] [-o sink]"
+  " [-i ring[,slots]] [-F text|json|binary] [-L rate[,burst]] [-J] [-M]"
+  " [-P socket] [-Y socket] [-c config_file]\n"
+  "  a limit of 0 means no limit\n"
+  "  -S runs on a simulated clock starting at start_time, moved by \"advance\"\n"
+  "  -C gives display threads copy-on-write snapshots of their alarms\n"
+  "  -I picks the input/output backend, io_uring when available by default\n"
+  "  -o sends the output to file:path, log:path[,bytes[,seconds]] (rotated)\n"
+  "     or ring:path[,bytes] (shared memory ring buffer, see ring_cat)\n"
+  "  -i takes the commands from a shared memory command ring instead of stdin\n"
+  "  -F writes events as JSON lines or binary records instead of text\n"
+  "  -L displays at most rate lines a second per message type, after a burst\n"
+  "     of burst lines (rate by default)\n"
+  "  -J spreads the first deadlines of alarms over their period\n"
+  "  -M displays every message type from one thread, in deadline order\n"
+  "     (not with -C)\n"
+  "  -P sends the input to a standby connected to the socket (primary)\n"
+  "  -Y follows the primary listening on the socket, muted, and takes over\n"
+  "     with its own input once the primary is gone (standby)\n"
+  "  -c reads settings (\"name value\" lines) that \"set\" can change later\n",
+  name);
+  exit(1);
+}
 
-        ready++; //
-        while(read_count > 0 || writing > 0){
-          // busy wait
+int main (int argc, char *argv[]){
+  int status, opt;
+  char line[128];
+  size_t len;
+  pthread_t thread;
+  int io_backend = IO_AUTO;
+  char *sink = NULL; // -o, stdout when not given
+  char *ring_path = NULL, *comma; // -i
+  long ring_slots = CMD_RING_SLOTS;
+
+  while ((opt = getopt(argc, argv, "a:t:w:m:q:R:S:CI:o:i:F:L:JMP:Y:c:")) != -1){
+    switch (opt){
+      case 'a': limits.max_alarms = atoi(optarg); break;
+      case 't': limits.max_per_type = atoi(optarg); break;
+      case 'w': limits.max_workers = atoi(optarg); break;
+      case 'm': limits.max_memory = atol(optarg); break;
+      case 'q': max_queue = atoi(optarg); break;
+      case 'R':
+        clock_gettime(CLOCK_MONOTONIC, &record_start);
+        if ((record_file = fopen(optarg, "w")) == NULL)
+          errno_abort ("Open record file");
+        break;
+      case 'S': clock_simulate(atol(optarg)); break;
+      case 'C': cow_mode = 1; break;
+      case 'J': jitter = 1; break;
+      case 'M': merged_mode = 1; break;
+      case 'P': primary_path = optarg; break;
+      case 'Y': standby_path = optarg; break;
+      case 'c': read_config(optarg); break;
+      case 'I':
+        if (strcmp(optarg, "uring") == 0)
+          io_backend = IO_URING;
+        else if (strcmp(optarg, "plain") == 0)
+          io_backend = IO_PLAIN;
+        else
+          usage(argv[0]);
+        break;
+      case 'o': sink = optarg; break;
+      case 'L':
+        rate_limit = rate_burst = atof(optarg);
+        if ((comma = strchr(optarg, ',')) != NULL)
+          rate_burst = atof(comma + 1);
+        if (rate_limit <= 0 || rate_burst < 1)
+          usage(argv[0]);
+        break;
+      case 'F':
+        if (event_set_format(optarg) < 0)
+          usage(argv[0]);
+        break;
+      case 'i':
+        ring_path = optarg;
+        if ((comma = strchr(optarg, ',')) != NULL){
+          *comma = '\0';
+          ring_slots = atol(comma + 1);
         }
-        status = sem_wait(&rw_sem);
-        if(status != 0)
-          err_abort(status, "rw_sem wait");
-        writing++; // writer has control of the data structure
-
-        /*
-        * Insert the new alarm into the list of alarms
-        * Insert the new thread into the list of threads
-        */
-        alarm_insert (alarm);
-        printf("Type B Create Thread Alarm Request With Message Type (%d)"
-        " Inserted Into Alarm List at <%d>!\n", alarm->type, (int)time(NULL));
-        insert_flag = 1; // a new alarm has been inserted
-
-        writing--;
-        status = sem_post(&rw_sem);
-        if(status != 0)
-          err_abort(status, "rw_sem post");
-        ready--;
-      }
+        if (ring_path[0] == '\0' || ring_slots <= 0)
+          usage(argv[0]);
+        break;
+      default: usage(argv[0]);
     }
-    /*********************END TYPE B*************************/
-    /*************************TYPE C*************************/
-    else if (sscanf (line, "Cancel: Message(%d)", &alarm->number) == 1 &&
-    alarm->number > 0 ){ //
-
-      int exists = check_number_a_exists(alarm->number);
-      int dup2 = check_dup_2(alarm->number, TYPE_C);
+  }
+  if (limits.max_alarms < 0 || limits.max_per_type < 0 || limits.max_workers < 0
+    || limits.max_memory < 0 || max_queue <= 0 || (cow_mode && merged_mode))
+    usage(argv[0]);
+
+#ifdef PERTURB
+  if (getenv("PERTURB_SEED") != NULL)
+    perturb_seed = strtoul(getenv("PERTURB_SEED"), NULL, 10);
+#endif
+  if (io_setup(io_backend) != io_backend && io_backend != IO_AUTO)
+    fprintf (stderr, "io_uring not available, using plain reads and writes\n");
+  if (sink != NULL && out_sink(sink) < 0)
+    usage(argv[0]);
+  atexit(out_sync); // buffered output is written before the program ends
+  interactive = isatty(STDIN_FILENO);
+  find_namespace("", 0); // the default namespace
+  input_hazard = hazard_acquire();
 
-      /*
-      * Creates a Type C alarm that is then inserted into the alarm list.
-      * Does not allow for duplicate type alarms.
-      * Only creates one if there exists a type A alarm of type C's Message
-      * Type.
-      */
+  status = sem_init(&rw_sem, 0, 1); // initialize reader writer Semaphore
+  if(status != 0)
+    err_abort(status, "Create READ-WRITE Semaphore");
 
-      if (exists == 0){ // A.3.2.6
+  status = sem_init(&queue_mutex, 0, 1); // initialize dispatch queue Semaphores
+  if(status != 0)
+    err_abort(status, "Create Queue Mutex Semaphore");
 
-        printf("Error: No Alarm Request With Message"
-          " Number (%d) to Cancel!\n", alarm->number );
-        free(alarm);
+  status = sem_init(&queue_items, 0, 0);
+  if(status != 0)
+    err_abort(status, "Create Queue Semaphore");
 
-      }else if (dup2 == 1){ // A.3.2.7
+  status = sem_init(&queue_slots, 0, max_queue);
+  if(status != 0)
+    err_abort(status, "Create Queue Slots Semaphore");
 
-        printf("Error: More Than One Request to Cancel Alarm Request With"
-          " Message Number (%d)!\n", alarm->number);
-        free(alarm);
+  /*
+  * Create the initial thread responsible for looping through the alarm list
+  * and performing operations depening on the request type
+  *
+  * leaving the argument "NULL" would also imply that the initial thread
+  */
+  status = pthread_create (&thread, NULL, alarm_thread, NULL);
+  if (status != 0) err_abort (status, "Create alarm thread");
 
-      }else if (exists == 1 && dup2 == 0 ){ // A.3.2.8
+  if (merged_mode){
+    clock_join(&merged_clock);
+    status = pthread_create (&merged_thread, NULL, merged_display_thread, NULL);
+    if (status != 0) err_abort (status, "Create merged display thread");
+  }
 
-        alarm->request_type = TYPE_C;
-        alarm->is_new = 1;
+  if (primary_path != NULL)
+    replica_listen(primary_path, send_state);
+  if (standby_path != NULL)
+    follow_primary(replica_follow(standby_path, 10));
 
+  if (ring_path != NULL){
+    ingest_ring(cmd_ring_create(ring_path, ring_slots));
+    unlink(ring_path); // no producer can use it any more
+    exit (0);
+  }
 
-        ready++;
-        while(read_count > 0 || writing > 0){
-          // busy wait
-        }
-        status = sem_wait(&rw_sem);
-        if(status != 0)
-          err_abort(status, "rw_sem wait");
-        writing++; // writer has control of the data structure
-
-        /*
-        * Insert the new alarm into the list of alarms.
-        */
-        alarm_insert (alarm);
-        printf("Type C Cancel Alarm Request With Message Number (%d)"
-          " Inserted Into Alarm List at <%d>: <Type C>\n", alarm->number,
-              (int)time(NULL));
-
-        insert_flag = 1; // a new alarm has been inserted
-
-        writing--;
-        status = sem_post(&rw_sem);
-        if(status != 0)
-          err_abort(status, "rw_sem post");
-        ready--;
-      }
-    }
-    /*********************END TYPE C*************************/
-    else if (sscanf(line,"%s", deb) && strcmp("debug",deb) == 0){ // debugging
-      if (debug_flag == 0){
-        printf("**DEBUG MODE ENGAGED**\n");
-        debug_flag = 1;
-      }else{
-        printf("**DEBUG MODE DISENGAGED**\n");
-        debug_flag = 0;
-      }
+  if (!interactive){
+    ingest_batch();
+    exit (0);
+  }
 
-    }
-    else{
-      fprintf (stderr, "Bad command\n");
-      free (alarm);
-    }
+  while (1) {
+    if (sink == NULL && event_format == FORMAT_TEXT){
+      out_printf ("alarm> ");
+      out_flush();
+    }else if (sink != NULL){ // the prompt stays on the terminal
+      printf ("alarm> ");
+      fflush (stdout);
+    } // and is left out of structured output
+    if (fgets (line, sizeof (line), stdin) == NULL) exit (0);
+    if ((len = strlen (line)) <= 1) continue;
+    if (line[len - 1] == '\n') len--;
+    replica_lock();
+    process_line(line, len);
+    if (record_file != NULL)
+      fflush(record_file);
+    replica_flush();
+    replica_unlock();
   }// end while
 }
@@ -0,0 +1,158 @@
+/*
+* alarm_clock.c
+*
+* Real and simulated clock for the alarm program, see alarm_clock.h.
+*
+* With the simulated clock, clock_mutex protects the worker list and the
+* fields of the workers. clock_advance() hands the turn to one worker at a
+* time and waits on clock_cond until that worker has made its pass (or has
+* left), so everything printed for one simulated second comes out in the same
+* order on every run. Each worker waits on its own condition variable, so a
+* turn wakes only the worker that gets it.
+*/
+#include <pthread.h>
+#include <errno.h>
+#include "alarm_clock.h"
+
+static int simulated = 0;
+static time_t sim_now; // the simulated time, only changed by clock_advance()
+
+static pthread_mutex_t clock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clock_cond = PTHREAD_COND_INITIALIZER; // for clock_advance()
+static clock_worker_t *workers = NULL; // in the order they joined
+static clock_worker_t *turn = NULL; // worker that has the turn
+static clock_worker_t *after_turn = NULL; // its successor, once it has left
+
+void clock_simulate(time_t start){
+  sim_now = start;
+  simulated = 1;
+}
+
+int clock_is_simulated(){
+  return simulated;
+}
+
+time_t clock_now(){
+  struct timespec now;
+
+  if (simulated)
+    return __atomic_load_n(&sim_now, __ATOMIC_ACQUIRE);
+
+  /*
+  * the same clock clock_next_pass() sleeps on, so that a worker woken at the
+  * start of a second never reads the second before it
+  */
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec;
+}
+
+void clock_join(clock_worker_t *worker){
+  clock_worker_t **last;
+
+  worker->link = NULL;
+  worker->next = INT64_MIN; // its first pass is at the next advance
+  worker->go = 0;
+  worker->passes = 0;
+  if (!simulated)
+    return;
+  pthread_cond_init(&worker->turn, NULL);
+
+  pthread_mutex_lock(&clock_mutex);
+  for (last = &workers; *last != NULL; last = &(*last)->link)
+    ;
+  *last = worker;
+  pthread_mutex_unlock(&clock_mutex);
+}
+
+void clock_leave(clock_worker_t *worker){
+  clock_worker_t **last;
+
+  if (!simulated)
+    return;
+
+  pthread_mutex_lock(&clock_mutex);
+  for (last = &workers; *last != NULL; last = &(*last)->link)
+    if (*last == worker){
+      *last = worker->link;
+      break;
+    }
+  if (turn == worker){
+    after_turn = worker->link;
+    turn = NULL;
+    pthread_cond_signal(&clock_cond);
+  }
+  pthread_mutex_unlock(&clock_mutex);
+  pthread_cond_destroy(&worker->turn);
+}
+
+/*
+* cancellation cleanup handler of the wait in clock_next_pass()
+*/
+static void unlock_clock(void *arg){
+  pthread_mutex_unlock(&clock_mutex);
+}
+
+void clock_next_pass(clock_worker_t *worker, int64_t next){
+  struct timespec wake;
+
+  if (!simulated){
+    if (worker->passes++ == 0)
+      return; // the first pass is made straight away
+    clock_gettime(CLOCK_REALTIME, &wake);
+    wake.tv_sec++;
+    wake.tv_nsec = 0;
+    while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, NULL) == EINTR){
+      // interrupted by a signal, sleep again
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&clock_mutex);
+  pthread_cleanup_push(unlock_clock, NULL); // the wait is a cancellation point
+  if (worker->go){ // the pass of the turn is done
+    worker->next = next;
+    worker->go = 0;
+    worker->passes++;
+    pthread_cond_signal(&clock_cond);
+  }
+  while (!worker->go)
+    pthread_cond_wait(&worker->turn, &clock_mutex);
+  pthread_cleanup_pop(1);
+}
+
+void clock_advance(long seconds){
+  clock_worker_t *worker, *next;
+  time_t target, step;
+
+  pthread_mutex_lock(&clock_mutex);
+  target = sim_now + seconds;
+  while (sim_now < target){
+
+    /*
+    * jump straight to the next second at which an alarm is due, since the
+    * seconds in between would not print anything
+    */
+    step = target;
+    for (worker = workers; worker != NULL; worker = worker->link)
+      if (worker->next < step)
+        step = worker->next;
+    if (step <= sim_now)
+      step = sim_now + 1;
+    __atomic_store_n(&sim_now, step, __ATOMIC_RELEASE);
+
+    for (worker = workers; worker != NULL; worker = next){
+      if (worker->next > step){
+        next = worker->link; // nothing due, its pass would be skipped
+        continue;
+      }
+      turn = worker;
+      worker->go = 1;
+      pthread_cond_signal(&worker->turn);
+      while (turn == worker && worker->go)
+        pthread_cond_wait(&clock_cond, &clock_mutex);
+      next = turn == worker ? worker->link : after_turn;
+    }
+    turn = NULL;
+  }
+  pthread_mutex_unlock(&clock_mutex);
+}
@@ -0,0 +1,62 @@
+/*
+* alarm_clock.h
+*
+* The clock every alarm time is taken from. It is either the real time of day
+* (the default) or a simulated clock that only moves when clock_advance() is
+* called, so that hours of alarms can be run in a fraction of a second and
+* always give the same output.
+*
+* Periodic display threads are the clock's workers: each one calls
+* clock_next_pass() before every pass over its alarms.
+*   - With the real clock, this sleeps until the next second starts (alarm
+*     times are whole seconds, so nothing can become due in between).
+*   - With the simulated clock, this waits for clock_advance() to give the
+*     worker its turn. clock_advance() lets the workers make their passes
+*     one at a time, in the order they joined, for every simulated second at
+*     which one of them has an alarm due. Only the workers whose "next" has
+*     come get a turn, so a worker with other work to do (a notice to print)
+*     sets its "next" to INT64_MIN.
+*/
+#ifndef __alarm_clock_h
+#define __alarm_clock_h
+
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+
+typedef struct clock_worker_tag {
+  struct clock_worker_tag *link;
+  int64_t               next; // earliest deadline of the worker's alarms
+  int                   go; // 1 while the worker has its turn
+  int                   passes; // passes made so far
+  pthread_cond_t        turn; // signalled when the worker gets its turn
+} clock_worker_t;
+
+void clock_simulate(time_t start); // switch to the simulated clock at "start"
+int clock_is_simulated();
+time_t clock_now();
+
+/*
+* Adds a worker. Called for a display thread before it is created, so that
+* no advance can miss it.
+*/
+void clock_join(clock_worker_t *worker);
+
+/*
+* Removes a worker. Called from the display thread's cleanup handler.
+*/
+void clock_leave(clock_worker_t *worker);
+
+/*
+* Called by a worker before each pass. "next" is the earliest deadline of its
+* alarms after the previous pass (INT64_MAX if it has none).
+*/
+void clock_next_pass(clock_worker_t *worker, int64_t next);
+
+/*
+* Moves the simulated clock "seconds" forward, returning when every worker
+* has made its passes.
+*/
+void clock_advance(long seconds);
+
+#endif
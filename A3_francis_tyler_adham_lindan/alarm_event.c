@@ -0,0 +1,155 @@
+/*
+* alarm_event.c
+*
+* JSON and binary event records, see alarm_event.h. A record is built in a
+* local buffer with the formatters of fmt.h and handed to out_write() in one
+* piece, so records of different threads never mix.
+*/
+#include <string.h>
+#include "alarm_io.h"
+#include "fmt.h"
+#include "alarm_event.h"
+
+int event_format = FORMAT_TEXT;
+
+static const char *const event_names[] = {
+  [EVENT_NOTE] = "note", [EVENT_FIRED] = "fired", [EVENT_INSERTED] = "inserted",
+  [EVENT_REPLACED] = "replaced", [EVENT_MOVED] = "moved",
+  [EVENT_CANCELLED] = "cancelled", [EVENT_CREATED] = "created",
+  [EVENT_TERMINATED] = "terminated"
+};
+
+int event_set_format(const char *name){
+  if (strcmp(name, "text") == 0)
+    event_format = FORMAT_TEXT;
+  else if (strcmp(name, "json") == 0)
+    event_format = FORMAT_JSON;
+  else if (strcmp(name, "binary") == 0)
+    event_format = FORMAT_BINARY;
+  else
+    return -1;
+  return 0;
+}
+
+/*
+* returns the length of the valid UTF-8 sequence of at least 2 bytes at the
+* start of the "len" bytes of "s", or 0 if there is none there
+*/
+static size_t utf8_length(const unsigned char *s, size_t len){
+  size_t need, i;
+  uint32_t code;
+
+  if (s[0] >= 0xc2 && s[0] <= 0xdf){
+    need = 2; code = s[0] & 0x1f;
+  }else if (s[0] >= 0xe0 && s[0] <= 0xef){
+    need = 3; code = s[0] & 0x0f;
+  }else if (s[0] >= 0xf0 && s[0] <= 0xf4){
+    need = 4; code = s[0] & 0x07;
+  }else{
+    return 0;
+  }
+  if (len < need)
+    return 0;
+  for (i = 1; i < need; i++){
+    if ((s[i] & 0xc0) != 0x80)
+      return 0;
+    code = code << 6 | (s[i] & 0x3f);
+  }
+  if ((need == 3 && (code < 0x800 || (code >= 0xd800 && code <= 0xdfff))) ||
+    (need == 4 && (code < 0x10000 || code > 0x10ffff)))
+    return 0; // overlong, surrogate or out of range
+  return need;
+}
+
+/*
+* appends the "len" bytes of "s" as a JSON string, quotes included, and
+* returns the new end. Valid UTF-8 is copied as it is; control characters,
+* DEL and bytes that are not part of valid UTF-8 are written as \u00XX (the
+* byte read as Latin-1), so the line is always valid JSON. Needs room for 6
+* bytes per byte of "s", plus 2.
+*/
+static char *put_string(char *p, const char *s, size_t len){
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *u = (const unsigned char *)s;
+  unsigned char c;
+  size_t run;
+
+  *p++ = '"';
+  while (len > 0){
+    c = *u;
+    if (c >= 0x80 && (run = utf8_length(u, len)) > 0){
+      memcpy(p, u, run);
+      p += run;
+      u += run;
+      len -= run;
+      continue;
+    }
+    if (c == '"' || c == '\\'){
+      *p++ = '\\';
+      *p++ = c;
+    }else if (c < 0x20 || c >= 0x7f){
+      p = fmt_literal(p, "\\u00");
+      *p++ = hex[c >> 4];
+      *p++ = hex[c & 0xf];
+    }else{
+      *p++ = c;
+    }
+    u++;
+    len--;
+  }
+  *p++ = '"';
+  return p;
+}
+
+void event_write(const char *ns, int kind, long time, int type, int number,
+  const char *message, size_t len){
+  char line[64 + 6 * 32 + 6 * EVENT_TEXT_SIZE], *p = line;
+  event_record_t record;
+
+  if (len > EVENT_TEXT_SIZE - 1)
+    len = EVENT_TEXT_SIZE - 1;
+
+  if (event_format == FORMAT_BINARY){
+    memset(&record, 0, sizeof(record));
+    record.size = sizeof(record);
+    record.version = EVENT_RECORD_VERSION;
+    record.kind = kind;
+    record.time = time;
+    record.type = type;
+    record.number = number;
+    strncpy(record.ns, ns, sizeof(record.ns) - 1);
+    if (message != NULL)
+      memcpy(record.text, message, len);
+    out_write((const char *)&record, sizeof(record));
+    return;
+  }
+
+  p = fmt_literal(p, "{\"event\":\"");
+  p = fmt_string(p, event_names[kind], 16);
+  *p++ = '"';
+  if (ns[0] != '\0'){
+    p = fmt_literal(p, ",\"ns\":");
+    p = put_string(p, ns, strnlen(ns, 31));
+  }
+  if (kind == EVENT_NOTE){
+    p = fmt_literal(p, ",\"text\":");
+    p = put_string(p, message, len);
+  }else{
+    p = fmt_literal(p, ",\"time\":");
+    p = fmt_int(p, time);
+    if (type > 0){
+      p = fmt_literal(p, ",\"type\":");
+      p = fmt_int(p, type);
+    }
+    if (number > 0){
+      p = fmt_literal(p, ",\"number\":");
+      p = fmt_int(p, number);
+    }
+    if (message != NULL){
+      p = fmt_literal(p, ",\"message\":");
+      p = put_string(p, message, len);
+    }
+  }
+  p = fmt_literal(p, "}\n");
+  out_write(line, p - line);
+}
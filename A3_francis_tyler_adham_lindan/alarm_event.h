@@ -0,0 +1,72 @@
+/*
+* alarm_event.h
+*
+* Structured output (-F json or -F binary): instead of its text line, every
+* event is written as one JSON object per line or as one fixed size binary
+* record, so that programs reading the output do not have to parse the
+* sentences meant for people. The records are formatted by hand, without
+* printf.
+*
+* JSON lines look like
+*
+*     {"event":"fired","time":10,"type":2,"number":1,"message":"hi"}
+*
+* with "ns" after "event" for a named namespace, and "type", "number" and
+* "message" only when the event has them. Lines that are not events (errors,
+* acknowledgements, stats) become {"event":"note","text":"<the line>"}.
+*
+* Binary records are event_record_t in the byte order of the machine. Each
+* starts with its size and version, so that a reader can skip records of a
+* later, larger version it does not know; fields are only ever added at the
+* end.
+*/
+#ifndef __alarm_event_h
+#define __alarm_event_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FORMAT_TEXT   0
+#define FORMAT_JSON   1
+#define FORMAT_BINARY 2
+
+#define EVENT_NONE      -1 // a text line that another event already covers
+#define EVENT_NOTE       0 // any other line, in "text"
+#define EVENT_FIRED      1 // an alarm was displayed
+#define EVENT_INSERTED   2 // a Type A request added an alarm
+#define EVENT_REPLACED   3 // a Type A request replaced an alarm
+#define EVENT_MOVED      4 // a display thread lost an alarm to another type
+#define EVENT_CANCELLED  5 // a Type C request removed an alarm
+#define EVENT_CREATED    6 // a display thread was created
+#define EVENT_TERMINATED 7 // a display thread was terminated
+
+#define EVENT_TEXT_SIZE 192
+#define EVENT_RECORD_VERSION 2 // 1 had no size and version, and a 32 bit time
+
+typedef struct event_record_tag {
+  uint16_t            size; // bytes in the record, sizeof(event_record_t)
+  uint16_t            version; // EVENT_RECORD_VERSION
+  uint32_t            kind; // EVENT_ value
+  int64_t             time; // 0 for notes
+  int32_t             type; // message type, 0 if the event has none
+  int32_t             number; // message number, 0 if the event has none
+  char                ns[32]; // namespace, "" for the default one
+  char                text[EVENT_TEXT_SIZE]; // message of the alarm, or the note
+} event_record_t;
+
+extern int event_format; // FORMAT_ value, FORMAT_TEXT unless -F is given
+
+/*
+* Selects the format called "name" ("text", "json" or "binary"). Returns -1
+* if there is no such format.
+*/
+int event_set_format(const char *name);
+
+/*
+* Writes one event in the structured format. "ns" is the namespace name,
+* "message" may be NULL and is at most "len" bytes long.
+*/
+void event_write(const char *ns, int kind, long time, int type, int number,
+  const char *message, size_t len);
+
+#endif
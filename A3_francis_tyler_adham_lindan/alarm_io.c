@@ -0,0 +1,557 @@
+/*
+* alarm_io.c
+*
+* io_uring and plain backends for the alarm program's input and output, see
+* alarm_io.h.
+*
+* Input and output have a ring each, since main may wait for input for as
+* long as the user likes while the display threads keep writing. The output
+* ring is only used under out_mutex. At most one write is in flight at a
+* time, so that the output stays in order; the other buffer fills meanwhile.
+*
+* The ring buffer sink takes the place of the backend for output: a flush
+* copies the buffer into the shared memory, which is all a write costs.
+*/
+#define _GNU_SOURCE // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "errors.h"
+#include "alarm_io.h"
+
+typedef struct ring_tag {
+  int                 fd;
+  unsigned int        *sq_tail, *sq_mask, *sq_array;
+  unsigned int        *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  int                 busy; // 1 while the submitted operation has not completed
+  int                 result; // of the last operation, once completed
+} ring_t;
+
+static int backend = IO_PLAIN;
+static long syscalls = 0;
+static ring_t in_ring, out_ring;
+
+static pthread_mutex_t out_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static char out_buffer[2][OUT_BLOCK];
+static size_t out_len = 0; // bytes in out_buffer[out_cur]
+static int out_cur = 0;
+static int out_muted = 0;
+static size_t out_block = OUT_BLOCK; // out_buffer is flushed when this full
+
+#define SINK_STDOUT 0
+#define SINK_FILE   1
+#define SINK_LOG    2
+#define SINK_RING   3
+
+static int sink = SINK_STDOUT;
+static int out_fd = STDOUT_FILENO;
+static char *log_path; // SINK_LOG: where the current log is
+static long log_max_bytes = 64L << 20, log_max_age = 0; // 0 means no limit
+static long log_bytes; // written to the current log
+static time_t log_opened;
+static out_ring_t *ring_sink; // SINK_RING
+
+static int read_fd; // the read io_read_start() asked for
+static void *read_buf;
+static size_t read_len;
+
+static void count_syscalls(long n){
+  __atomic_add_fetch(&syscalls, n, __ATOMIC_RELAXED);
+}
+
+/*
+* Sets up an io_uring with "entries" entries. Returns -1 if the kernel does
+* not allow it.
+*/
+static int ring_init(ring_t *ring, unsigned int entries){
+  struct io_uring_params params;
+  char *sq, *cq;
+
+  memset(&params, 0, sizeof(params));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0)
+    return -1;
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)){
+    close(ring->fd); // pipes and files need "current position" writes
+    return -1;
+  }
+
+  sq = mmap(NULL, params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  cq = mmap(NULL, params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (sq == MAP_FAILED || cq == MAP_FAILED || ring->sqes == MAP_FAILED)
+    errno_abort ("Map io_uring");
+
+  ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  ring->busy = 0;
+  return 0;
+}
+
+/*
+* Submits one read or write at the current position of "fd".
+*/
+static void ring_submit(ring_t *ring, int opcode, int fd, void *buf, size_t len){
+  unsigned int tail = *ring->sq_tail, index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  int status;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->off = (__u64)-1; // current position, and pipes
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  count_syscalls(1);
+  while ((status = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0)) < 0
+    && errno == EINTR){
+    // interrupted by a signal, submit again
+  }
+  if (status != 1)
+    errno_abort ("Submit to io_uring");
+  ring->busy = 1;
+}
+
+/*
+* Waits for the operation in flight and returns its result. Looks at the
+* completion queue first, an operation that is already done costs no
+* system call.
+*/
+static int ring_wait(ring_t *ring){
+  unsigned int head;
+
+  if (!ring->busy)
+    return ring->result;
+  head = *ring->cq_head;
+  while (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)){
+    count_syscalls(1);
+    if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+      NULL, 0) < 0 && errno != EINTR)
+      errno_abort ("Wait for io_uring");
+  }
+  ring->result = ring->cqes[head & *ring->cq_mask].res;
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  ring->busy = 0;
+  return ring->result;
+}
+
+/*
+* Waits until "fd" is ready for "events". Only needed for non-blocking
+* descriptors (sockets, mostly), for which read() and write() fail with
+* EAGAIN instead of waiting.
+*/
+static void wait_ready(int fd, unsigned int events){
+  static __thread int epoll_fd = -1;
+  struct epoll_event event;
+
+  if (epoll_fd < 0 && (epoll_fd = epoll_create1(0)) < 0)
+    errno_abort ("Create epoll");
+  event.events = events | EPOLLONESHOT;
+  event.data.fd = fd;
+  count_syscalls(2);
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0 &&
+    (errno != EEXIST || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0))
+    errno_abort ("Watch descriptor");
+  while (epoll_wait(epoll_fd, &event, 1, -1) < 0){
+    if (errno != EINTR)
+      errno_abort ("Wait for descriptor");
+  }
+}
+
+int io_setup(int wanted){
+  backend = IO_PLAIN;
+  if (wanted != IO_PLAIN && ring_init(&in_ring, 4) == 0){
+    if (ring_init(&out_ring, 4) == 0)
+      backend = IO_URING;
+    else
+      close(in_ring.fd);
+  }
+  return backend;
+}
+
+const char *io_backend_name(){
+  return backend == IO_URING ? "io_uring" : "plain";
+}
+
+long io_syscalls(){
+  return __atomic_load_n(&syscalls, __ATOMIC_RELAXED);
+}
+
+void io_read_start(int fd, void *buf, size_t len){
+  read_fd = fd;
+  read_buf = buf;
+  read_len = len;
+  if (backend == IO_URING)
+    ring_submit(&in_ring, IORING_OP_READ, fd, buf, len);
+}
+
+ssize_t io_read_finish(){
+  ssize_t got;
+
+  if (backend == IO_URING){
+    got = ring_wait(&in_ring);
+    if (got == -EAGAIN){ // non-blocking descriptor with nothing to read
+      wait_ready(read_fd, EPOLLIN);
+      ring_submit(&in_ring, IORING_OP_READ, read_fd, read_buf, read_len);
+      return io_read_finish();
+    }
+    if (got < 0){
+      errno = -got;
+      return -1;
+    }
+    return got;
+  }
+
+  while (1){
+    count_syscalls(1);
+    if ((got = read(read_fd, read_buf, read_len)) >= 0)
+      return got;
+    if (errno == EAGAIN)
+      wait_ready(read_fd, EPOLLIN);
+    else if (errno != EINTR)
+      return -1;
+  }
+}
+
+/*
+* Reports a failed write. A reader that went away kills the program the way
+* it did when output went through stdio.
+*/
+static void write_failed(int error){
+  if (error == EPIPE)
+    raise(SIGPIPE);
+  errno = error;
+  errno_abort ("Write output");
+}
+
+/*
+* Writes all "len" bytes of "buf" to stdout and waits until they are
+* written.
+*/
+static void write_all(const char *buf, size_t len){
+  ssize_t done;
+
+  while (len > 0){
+    if (backend == IO_URING){
+      ring_submit(&out_ring, IORING_OP_WRITE, out_fd, (void *)buf, len);
+      done = ring_wait(&out_ring);
+      if (done == -EAGAIN){
+        wait_ready(out_fd, EPOLLOUT);
+        continue;
+      }
+      if (done < 0)
+        write_failed(-done);
+    }else{
+      count_syscalls(1);
+      if ((done = write(out_fd, buf, len)) < 0){
+        if (errno == EAGAIN)
+          wait_ready(out_fd, EPOLLOUT);
+        else if (errno != EINTR)
+          write_failed(errno);
+        continue;
+      }
+    }
+    buf += done;
+    len -= done;
+  }
+}
+
+/*
+* Waits for the write in flight (io_uring only) and finishes it if it was
+* short.
+*
+* Requires out_mutex.
+*/
+static void wait_write(){
+  static size_t submitted; // bytes of the write in flight
+  int done;
+
+  if (backend != IO_URING)
+    return;
+  if (out_ring.busy){
+    done = ring_wait(&out_ring);
+    if (done == -EAGAIN)
+      done = 0;
+    else if (done < 0)
+      write_failed(-done);
+    if ((size_t)done < submitted) // the other buffer is the one written
+      write_all(out_buffer[!out_cur] + done, submitted - done);
+  }
+  submitted = out_len;
+}
+
+/*
+* Opens the file of a file or log sink for appending.
+*/
+static int open_sink(const char *path){
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if (fd < 0)
+    errno_abort ("Open output file");
+  return fd;
+}
+
+/*
+* Moves the log to path.1, after shifting the older ones up by one (the
+* oldest is overwritten), and starts a new one.
+*
+* Requires out_mutex.
+*/
+static void rotate_log(){
+  char from[4096], to[4096];
+  int i;
+
+  wait_write(); // the write in flight belongs to the old log
+  close(out_fd);
+  for (i = LOG_KEEP - 1; i > 0; i--){
+    snprintf(from, sizeof(from), "%s.%d", log_path, i);
+    snprintf(to, sizeof(to), "%s.%d", log_path, i + 1);
+    rename(from, to); // fails when there is no such log yet
+  }
+  snprintf(to, sizeof(to), "%s.1", log_path);
+  if (rename(log_path, to) < 0)
+    errno_abort ("Rotate output log");
+  out_fd = open_sink(log_path);
+  log_bytes = 0;
+  log_opened = time(NULL);
+}
+
+/*
+* Copies "len" bytes to the ring buffer and publishes them.
+*
+* Requires out_mutex.
+*/
+static void ring_put(const char *text, size_t len){
+  uint64_t head = ring_sink->head, size = ring_sink->size, at, part;
+
+  if (len > size){ // only the end would survive anyway
+    head += len - size;
+    text += len - size;
+    len = size;
+  }
+  at = head & (size - 1);
+  part = len < size - at ? len : size - at;
+
+  /*
+  * the claim is published before the bytes it covers are overwritten; a
+  * seq_cst exchange keeps the copies below from moving ahead of it, without
+  * the fence ThreadSanitizer cannot follow
+  */
+  __atomic_exchange_n(&ring_sink->reserve, head + len, __ATOMIC_SEQ_CST);
+  memcpy(ring_sink->data + at, text, part);
+  memcpy(ring_sink->data, text + part, len - part);
+  __atomic_store_n(&ring_sink->head, head + len, __ATOMIC_RELEASE);
+}
+
+/*
+* Creates the ring buffer file "path" holding "size" bytes of output.
+*/
+static void open_ring(const char *path, long size){
+  int fd;
+  uint64_t bytes = 1, magic;
+
+  while (bytes < (uint64_t)size) // a power of 2, so that positions wrap
+    bytes *= 2;
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(out_ring_t) + bytes) < 0)
+    errno_abort ("Create output ring");
+  ring_sink = mmap(NULL, sizeof(out_ring_t) + bytes, PROT_READ | PROT_WRITE,
+    MAP_SHARED, fd, 0);
+  if (ring_sink == MAP_FAILED)
+    errno_abort ("Map output ring");
+  close(fd);
+  ring_sink->size = bytes;
+  ring_sink->head = 0;
+  ring_sink->reserve = 0;
+  memcpy(&magic, RING_MAGIC, sizeof(magic));
+  __atomic_store_n((uint64_t *)ring_sink->magic, magic, __ATOMIC_RELEASE); // last, readers check it
+}
+
+int out_sink(const char *spec){
+  char *path, *comma;
+  long first = 0, second = 0;
+
+  if (strncmp(spec, "file:", 5) == 0){
+    sink = SINK_FILE;
+    out_fd = open_sink(spec + 5);
+    return 0;
+  }
+  if (strncmp(spec, "log:", 4) == 0)
+    sink = SINK_LOG;
+  else if (strncmp(spec, "ring:", 5) == 0)
+    sink = SINK_RING;
+  else
+    return -1;
+
+  /*
+  * the numbers after the path, if any
+  */
+  if ((path = strdup(strchr(spec, ':') + 1)) == NULL)
+    errno_abort ("Allocate output path");
+  if ((comma = strchr(path, ',')) != NULL){
+    *comma++ = '\0';
+    first = strtol(comma, &comma, 10);
+    if (*comma == ',' && sink == SINK_LOG)
+      second = strtol(comma + 1, &comma, 10);
+    if (*comma != '\0' || first <= 0 || second < 0)
+      return -1;
+  }
+  if (path[0] == '\0')
+    return -1;
+
+  if (sink == SINK_RING){
+    open_ring(path, first > 0 ? first : RING_SIZE);
+    free(path);
+    return 0;
+  }
+  log_path = path;
+  if (first > 0)
+    log_max_bytes = first;
+  log_max_age = second;
+  out_fd = open_sink(path);
+  log_bytes = lseek(out_fd, 0, SEEK_END);
+  log_opened = time(NULL);
+  return 0;
+}
+
+const char *out_sink_name(){
+  static const char *const names[] = {
+    [SINK_STDOUT] = "stdout", [SINK_FILE] = "file", [SINK_LOG] = "log",
+    [SINK_RING] = "ring"
+  };
+
+  return names[sink];
+}
+
+void out_lock(){
+  pthread_mutex_lock(&out_mutex);
+}
+
+void out_unlock(){
+  pthread_mutex_unlock(&out_mutex);
+}
+
+void out_flush(){
+  int line_end; // the buffer ends with a whole line
+
+  out_lock();
+  if (out_len > 0){
+    line_end = out_buffer[out_cur][out_len - 1] == '\n';
+    if (sink == SINK_RING){
+      ring_put(out_buffer[out_cur], out_len);
+    }else if (backend == IO_URING){
+      wait_write(); // only one write in flight, to keep the order
+      ring_submit(&out_ring, IORING_OP_WRITE, out_fd, out_buffer[out_cur],
+        out_len);
+      out_cur = !out_cur;
+    }else{
+      write_all(out_buffer[out_cur], out_len);
+    }
+    log_bytes += out_len;
+    out_len = 0;
+
+    /*
+    * a log is only rotated between lines, so that no line is split over two
+    * files
+    */
+    if (sink == SINK_LOG && line_end && (log_bytes >= log_max_bytes ||
+      (log_max_age > 0 && time(NULL) - log_opened >= log_max_age)))
+      rotate_log();
+  }
+  out_unlock();
+}
+
+void out_set_block(size_t bytes){
+  out_lock();
+  out_block = bytes < 1 ? 1 : bytes > OUT_BLOCK ? OUT_BLOCK : bytes;
+  out_unlock();
+}
+
+size_t out_get_block(){
+  size_t bytes;
+
+  out_lock();
+  bytes = out_block;
+  out_unlock();
+  return bytes;
+}
+
+void out_mute(int on){
+  out_lock();
+  out_muted = on;
+  out_unlock();
+}
+
+void out_sync(){
+  out_lock();
+  out_flush();
+  out_len = 0;
+  wait_write();
+  out_unlock();
+}
+
+void out_write(const char *text, size_t len){
+  out_lock();
+  if (out_muted){
+    out_unlock();
+    return;
+  }
+  if (out_len + len > out_block)
+    out_flush();
+  if (len > OUT_BLOCK && sink == SINK_RING){ // longer than a buffer
+    ring_put(text, len);
+  }else if (len > OUT_BLOCK){
+    wait_write();
+    write_all(text, len);
+    log_bytes += len;
+  }else{
+    memcpy(out_buffer[out_cur] + out_len, text, len);
+    out_len += len;
+  }
+  out_unlock();
+}
+
+void out_vprintf(const char *format, va_list args){
+  char line[512], *text = line;
+  va_list copy;
+  int len;
+
+  va_copy(copy, args);
+  len = vsnprintf(line, sizeof(line), format, args);
+  if (len >= (int)sizeof(line)){ // rare, a long line
+    if ((text = malloc(len + 1)) == NULL)
+      errno_abort ("Allocate output line");
+    vsnprintf(text, len + 1, format, copy);
+  }
+  va_end(copy);
+  if (len > 0)
+    out_write(text, len);
+  if (text != line)
+    free(text);
+}
+
+void out_printf(const char *format, ...){
+  va_list args;
+
+  va_start(args, format);
+  out_vprintf(format, args);
+  va_end(args);
+}
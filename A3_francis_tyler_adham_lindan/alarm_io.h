@@ -0,0 +1,97 @@
+/*
+* alarm_io.h
+*
+* Input and output of the alarm program, through one of two backends:
+*   - io_uring: reads and writes are submitted to an io_uring (set up with the
+*     raw system calls, liburing is not needed) and run while the program
+*     goes on; the next input block is read while the current one is parsed
+*     and output is written while the next buffer fills.
+*   - plain: read() and write(), waiting in epoll_wait() when the descriptor
+*     is non-blocking and not ready. Used when io_uring is not available.
+*
+* Output of all threads goes to one buffer and is written in large blocks
+* instead of one printf per line; out_flush() hands the buffer to the
+* backend at the points where the output has to be visible. Where it goes is
+* the output sink: stdout, a file, a log rotated by size or age, or a ring
+* buffer in a shared memory file that local readers follow without system
+* calls (see ring_cat.c).
+*/
+#ifndef __alarm_io_h
+#define __alarm_io_h
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define IO_AUTO   0 // io_uring if the kernel allows it, else plain
+#define IO_URING  1
+#define IO_PLAIN  2
+
+#define OUT_BLOCK 65536 // bytes of output written at a time
+
+#define LOG_KEEP  4 // rotated logs kept: path.1 (newest) to path.4
+#define RING_SIZE (1 << 20) // default bytes of output a ring buffer holds
+
+/*
+* Start of a ring buffer file. The output follows it, byte "n" of the output
+* being at data[n % size]. "head" counts the bytes ever written and is
+* stored after the bytes it covers, so a reader that has read up to "tail"
+* can copy data up to "head". Before the writer copies bytes in, it stores
+* in "reserve" where they will end; if "reserve" has moved more than "size"
+* past "tail" by the time a reader's copy is done, the copy may have been
+* overwritten while it was made.
+*/
+#define RING_MAGIC "a3ring2"
+
+typedef struct out_ring_tag {
+  char                magic[8];
+  uint64_t            size; // bytes of data, a power of 2
+  uint64_t            head; // end of the bytes written
+  uint64_t            reserve; // end of the bytes being written
+  char                data[];
+} out_ring_t;
+
+/*
+* Selects the backend, returns the one in use (IO_URING or IO_PLAIN).
+* Call before any other function of this file.
+*/
+int io_setup(int backend);
+const char *io_backend_name();
+long io_syscalls(); // system calls made for input and output so far
+
+/*
+* Sends the output to the sink "spec" instead of stdout:
+*   file:path                    appended to a file
+*   log:path[,bytes[,seconds]]   a file moved to path.1 and started again
+*                                once it holds "bytes" (default 64MB) or is
+*                                "seconds" old (default never)
+*   ring:path[,bytes]            a ring buffer of "bytes" (default RING_SIZE)
+* Returns -1 if "spec" is not valid, and aborts if the sink cannot be made.
+*/
+int out_sink(const char *spec);
+const char *out_sink_name();
+
+/*
+* Input, main only: starts reading up to "len" bytes of "fd" into "buf",
+* then io_read_finish() waits for that read and returns its result like
+* read() does.
+*/
+void io_read_start(int fd, void *buf, size_t len);
+ssize_t io_read_finish();
+
+/*
+* Output to stdout. out_lock() keeps the lines of one caller together (it
+* can be taken more than once by the same thread).
+*/
+void out_lock();
+void out_unlock();
+void out_write(const char *text, size_t len);
+void out_vprintf(const char *format, va_list args);
+void out_printf(const char *format, ...);
+void out_set_block(size_t bytes); // flush once this much is buffered (<= OUT_BLOCK)
+size_t out_get_block();
+void out_mute(int on); // while on, output is dropped (a standby's, see replica.h)
+void out_flush(); // starts writing what is buffered
+void out_sync(); // writes what is buffered and waits until it is written
+
+#endif
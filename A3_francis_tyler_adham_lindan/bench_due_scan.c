@@ -0,0 +1,120 @@
+/*
+* bench_due_scan.c
+*
+* Microbenchmark for the due alarm scan. For 1K, 100K and 10M alarms it times
+* the old way of finding due alarms (walking a linked list of nodes and
+* checking "now >= alarm->time" per node) against each due_scan() kernel
+* running over a contiguous deadline array.
+*
+* About 1% of the alarms are due on every scan, roughly what a display thread
+* sees when its alarms have periods spread over a couple of minutes.
+*
+* usage: bench_due_scan [scans]
+*/
+#include <time.h>
+#include "errors.h"
+#include "due_scan.h"
+
+typedef struct node_tag {
+  struct node_tag     *link;
+  time_t              time;
+} node_t;
+
+/*
+* returns the current monotonic time in seconds
+*/
+static double now_sec(){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+* prints one result line: alarms checked per second and ns per alarm
+*/
+static void report(const char *name, size_t count, int scans, double secs,
+  size_t found){
+  double total = (double)count * scans;
+
+  printf("  %-8s %10.1f M alarms/s %8.3f ns/alarm (%zu due per scan)\n",
+    name, total / secs / 1e6, secs * 1e9 / total, found);
+}
+
+int main(int argc, char *argv[]){
+  static const size_t sizes[] = { 1000, 100000, 10000000 };
+  static const char *kernels[] = { "scalar", "sse4.2", "avx2" };
+  size_t s, i, k, found;
+  int scans, r;
+  int64_t now = 1000000;
+
+  scans = argc > 1 ? atoi(argv[1]) : 0;
+  printf("due_scan() uses the %s kernel on this CPU\n", due_scan_kernel_name());
+
+  for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+    size_t count = sizes[s];
+    int64_t *deadline = malloc(count * sizeof(int64_t));
+    uint32_t *due = malloc(count * sizeof(uint32_t));
+    node_t *list = NULL, *node;
+    int n = scans > 0 ? scans : (int)(200000000 / count) + 1;
+    double start;
+
+    if (deadline == NULL || due == NULL)
+      errno_abort("Allocate deadlines");
+
+    srand(3221);
+    for (i = 0; i < count; i++){
+      deadline[i] = now + 1 + rand() % 120;
+      if (rand() % 100 == 0)
+        deadline[i] = now - rand() % 4; // due
+    }
+
+    /*
+    * Build the list back to front so that its order matches the array, the
+    * way alarm_list is ordered by message number.
+    */
+    for (i = count; i > 0; i--){
+      node = malloc(sizeof(node_t));
+      if (node == NULL)
+        errno_abort("Allocate node");
+      node->time = deadline[i - 1];
+      node->link = list;
+      list = node;
+    }
+
+    printf("%zu alarms, %d scans\n", count, n);
+
+    start = now_sec();
+    for (r = 0; r < n; r++){
+      found = 0;
+      for (node = list; node != NULL; node = node->link)
+        if (now >= node->time)
+          due[found++] = 0;
+    }
+    report("list", count, n, now_sec() - start, found);
+
+    for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++){
+      size_t (*fn)(const int64_t *, size_t, int64_t, uint32_t *);
+
+      if (!due_scan_kernel_supported(kernels[k])){
+        printf("  %-8s not supported\n", kernels[k]);
+        continue;
+      }
+      fn = k == 0 ? due_scan_scalar : k == 1 ? due_scan_sse42 : due_scan_avx2;
+
+      start = now_sec();
+      for (r = 0; r < n; r++)
+        found = fn(deadline, count, now, due);
+      report(kernels[k], count, n, now_sec() - start, found);
+    }
+
+    while (list != NULL){
+      node = list->link;
+      free(list);
+      list = node;
+    }
+    free(deadline);
+    free(due);
+  }
+  return 0;
+}
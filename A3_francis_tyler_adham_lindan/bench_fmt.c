@@ -0,0 +1,102 @@
+/*
+* bench_fmt.c
+*
+* Microbenchmark for the output formatters. Formats the line of a displayed
+* alarm,
+*
+*     Alarm With Message Type (%d) and Message Number (%d) Displayed at <%d>:
+*     <Type A> : "%s"
+*
+* with snprintf, the way ns_printf() did, and with the fmt.h formatters, the
+* way print_fired() does, and reports lines per second for both. The time
+* changes every 1000 lines, as it does when many alarms fall due in the same
+* second. Both ways must produce the same bytes, which is checked on the
+* first lines before anything is timed.
+*
+* usage: bench_fmt [lines]
+*/
+#include <time.h>
+#include "errors.h"
+#include "fmt.h"
+
+/*
+* returns the current monotonic time in seconds
+*/
+static double now_sec(){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *messages[] = { "hi", "wake up", "stress 123456",
+  "a longer message, as people tend to type them" };
+static const time_t base = 1760000000;
+
+/*
+* formats line "i" with snprintf and returns its length
+*/
+static long line_printf(char *line, size_t size, long i){
+  return snprintf(line, size, "Alarm With Message Type (%d) and Message"
+    " Number (%d) Displayed at <%d>: <Type A> : \"%s\"\n", (int)(i % 64) + 1,
+    (int)(i * 7919 % 100000) + 1, (int)(base + i / 1000), messages[i & 3]);
+}
+
+/*
+* formats line "i" with fmt.h and returns its length
+*/
+static long line_fmt(char *line, long i){
+  char *p;
+
+  p = fmt_literal(line, "Alarm With Message Type (");
+  p = fmt_int(p, (int)(i % 64) + 1);
+  p = fmt_literal(p, ") and Message Number (");
+  p = fmt_int(p, (int)(i * 7919 % 100000) + 1);
+  p = fmt_literal(p, ") Displayed at <");
+  p = fmt_time(p, (int)(base + i / 1000));
+  p = fmt_literal(p, ">: <Type A> : \"");
+  p = fmt_string(p, messages[i & 3], 128);
+  p = fmt_literal(p, "\"\n");
+  return p - line;
+}
+
+int main(int argc, char *argv[]){
+  char line[512], other[512];
+  long lines, i, len;
+  volatile long sink = 0; // keeps the lines from being optimised away
+  double start, secs_printf, secs_fmt;
+
+  lines = argc > 1 ? atol(argv[1]) : 5000000;
+  if (lines <= 0){
+    fprintf(stderr, "usage: %s [lines]\n", argv[0]);
+    exit(1);
+  }
+
+  for (i = 0; i < 1000000; i++){
+    len = line_printf(line, sizeof(line), i);
+    if (line_fmt(other, i) != len || memcmp(line, other, len) != 0){
+      fprintf(stderr, "bench_fmt: line %ld differs: %.*s", i, (int)len, line);
+      exit(1);
+    }
+  }
+
+  start = now_sec();
+  for (i = 0; i < lines; i++){
+    len = line_printf(line, sizeof(line), i);
+    sink += len + line[len - 3];
+  }
+  secs_printf = now_sec() - start;
+
+  start = now_sec();
+  for (i = 0; i < lines; i++){
+    len = line_fmt(line, i);
+    sink += len + line[len - 3];
+  }
+  secs_fmt = now_sec() - start;
+
+  printf("  %-8s %8.2f M lines/s %8.1f ns/line\n", "snprintf",
+    lines / secs_printf / 1e6, secs_printf * 1e9 / lines);
+  printf("  %-8s %8.2f M lines/s %8.1f ns/line (%.1fx)\n", "fmt",
+    lines / secs_fmt / 1e6, secs_fmt * 1e9 / lines, secs_printf / secs_fmt);
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*
+* cmd_parse.c
+*
+* Fast path parser for alarm requests, with the original sscanf formats as the
+* fallback for anything unusual (signs, extra spaces, very long numbers...).
+* The fast path only ever accepts lines that sscanf would accept with the same
+* values, so the two can never disagree.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "cmd_parse.h"
+
+#define MAX_DIGITS 9 // longest number the fast path converts (fits an int)
+
+#define PREFIX_B "Create_Thread: MessageType("
+#define PREFIX_C "Cancel: Message("
+#define INFIX_A " Message("
+
+/*
+* Converts the run of decimal digits at "p" into "value".
+*
+* Returns the number of digits used, or 0 if there are none or too many for
+* the fast path. When 8 bytes are available the digits are found and converted
+* with one 64 bit register treated as 8 lanes of one byte (SWAR): a lane is a
+* digit when its high nibble is 3 and its low nibble is below 10, and the
+* digits are combined pairwise with 3 multiplies instead of one per digit.
+*/
+static size_t parse_digits(const char *p, const char *end, int *value){
+  size_t len = 0;
+  int v = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (end - p >= 8){
+    uint64_t chunk, bad;
+
+    memcpy(&chunk, p, 8);
+    bad = ((chunk & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL)
+      | (((chunk & 0x0F0F0F0F0F0F0F0FULL) + 0x0606060606060606ULL)
+      & 0x1010101010101010ULL);
+    len = bad != 0 ? (size_t)__builtin_ctzll(bad) >> 3 : 8;
+
+    if (len == 0)
+      return 0;
+    if (len < 8){
+      /*
+      * Move the digits to the top of the register so that the lanes after
+      * them become leading zeros, then fold 8 lanes into one number.
+      */
+      chunk = (chunk - 0x3030303030303030ULL) << ((8 - len) * 8);
+      chunk = (chunk * 10) + (chunk >> 8);
+      chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+        + (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))))
+        >> 32;
+      *value = (int)(uint32_t)chunk;
+      return len;
+    }
+    len = 0; // 8 or more digits, count them one by one
+  }
+#endif
+
+  while (p + len < end && p[len] >= '0' && p[len] <= '9'){
+    if (len == MAX_DIGITS)
+      return 0;
+    v = v * 10 + (p[len] - '0');
+    len++;
+  }
+  *value = v;
+  return len;
+}
+
+/*
+* returns 1 if the "n" bytes at "p" (which must be inside the line) start
+* with the string "s" and 0 otherwise
+*/
+static int match(const char *p, const char *end, const char *s, size_t n){
+  return end - p >= (long)n && memcmp(p, s, n) == 0;
+}
+
+/*
+* returns 1 if the word at "p" is "word" and 0 otherwise
+*/
+static int match_word(const char *p, const char *end, const char *word){
+  size_t n = strlen(word);
+
+  return match(p, end, word, n) &&
+    (p + n == end || p[n] == ' ' || p[n] == '\t' || p[n] == '\r');
+}
+
+/*
+* Fast path. Returns the kind of command recognised, or CMD_BAD if the line
+* has to go through sscanf.
+*/
+static int parse_fast(const char *line, const char *end, command_t *cmd){
+  const char *p = line;
+  size_t n;
+
+  if (p == end)
+    return CMD_BAD;
+
+  switch (*p){
+  case 'C':
+    if (match(p, end, PREFIX_B, sizeof(PREFIX_B) - 1)){
+      p += sizeof(PREFIX_B) - 1;
+      if (parse_digits(p, end, &cmd->type) == 0 || cmd->type <= 0)
+        return CMD_BAD;
+      return CMD_TYPE_B;
+    }
+    if (match(p, end, PREFIX_C, sizeof(PREFIX_C) - 1)){
+      p += sizeof(PREFIX_C) - 1;
+      if (parse_digits(p, end, &cmd->number) == 0 || cmd->number <= 0)
+        return CMD_BAD;
+      return CMD_TYPE_C;
+    }
+    return CMD_BAD;
+
+  case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9':
+    if ((n = parse_digits(p, end, &cmd->seconds)) == 0)
+      return CMD_BAD;
+    p += n;
+    if (!match(p, end, INFIX_A, sizeof(INFIX_A) - 1))
+      return CMD_BAD;
+    p += sizeof(INFIX_A) - 1;
+    if ((n = parse_digits(p, end, &cmd->type)) == 0 || !match(p + n, end, ", ", 2))
+      return CMD_BAD;
+    p += n + 2;
+    if ((n = parse_digits(p, end, &cmd->number)) == 0 || !match(p + n, end, ") ", 2))
+      return CMD_BAD;
+    p += n + 2;
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+      p++; // the " " of the format skips any white space
+    if (p == end || cmd->seconds <= 0 || cmd->type <= 0 || cmd->number <= 0)
+      return CMD_BAD;
+
+    n = end - p;
+    if (n > MESSAGE_SIZE - 1)
+      n = MESSAGE_SIZE - 1; // same truncation as "%127[^\n]"
+    memcpy(cmd->message, p, n);
+    cmd->message[n] = '\0';
+    return CMD_TYPE_A;
+  }
+  return CMD_BAD;
+}
+
+int parse_command(const char *line, size_t len, command_t *cmd){
+  char buf[256];
+  const char *end = line + len;
+  const char *p;
+
+  cmd->kind = parse_fast(line, end, cmd);
+  if (cmd->kind != CMD_BAD)
+    return cmd->kind;
+
+  /*
+  * Keyword commands ("debug", "stats", "advance", "set") are the first word of the
+  * line, the way sscanf("%s") used to read it.
+  */
+  for (p = line; p < end && (*p == ' ' || *p == '\t' || *p == '\r'); p++)
+    ;
+  if (match_word(p, end, "debug"))
+    return cmd->kind = CMD_DEBUG;
+  if (match_word(p, end, "stats"))
+    return cmd->kind = CMD_STATS;
+  if (match_word(p, end, "advance")){
+    for (p += sizeof("advance") - 1; p < end && (*p == ' ' || *p == '\t'); p++)
+      ;
+    if (parse_digits(p, end, &cmd->seconds) == (size_t)(end - p) && cmd->seconds > 0)
+      return cmd->kind = CMD_ADVANCE;
+    return cmd->kind = CMD_BAD;
+  }
+  if (match_word(p, end, "set")){
+    for (p += sizeof("set") - 1; p < end && (*p == ' ' || *p == '\t'); p++)
+      ;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+      end--;
+    len = end - p;
+    if (len > MESSAGE_SIZE - 1)
+      len = MESSAGE_SIZE - 1;
+    memcpy(cmd->message, p, len);
+    cmd->message[len] = '\0';
+    return cmd->kind = CMD_SET;
+  }
+
+  /*
+  * Fallback: the formats main used before the fast path existed.
+  */
+  if (len > sizeof(buf) - 1)
+    len = sizeof(buf) - 1;
+  memcpy(buf, line, len);
+  buf[len] = '\0';
+
+  if (sscanf (buf, "%d Message(%d, %d) %127[^\n]",
+  &cmd->seconds, &cmd->type, &cmd->number, cmd->message) == 4 &&
+  cmd->seconds > 0 && cmd->number > 0 && cmd->type > 0) // A.3.2.1
+    cmd->kind = CMD_TYPE_A;
+  else if (sscanf(buf,"Create_Thread: MessageType(%d)",&cmd->type) == 1
+  && cmd->type > 0) // A.3.2.3 - A.3.2.5
+    cmd->kind = CMD_TYPE_B;
+  else if (sscanf (buf, "Cancel: Message(%d)", &cmd->number) == 1 &&
+  cmd->number > 0 )
+    cmd->kind = CMD_TYPE_C;
+
+  return cmd->kind;
+}
+
+/*
+* memchr is already vectorised by the C library (16 or 32 bytes per step on
+* x86), so the newline search is left to it.
+*/
+const char *find_line_end(const char *p, const char *end){
+  const char *nl = memchr(p, '\n', end - p);
+
+  return nl != NULL ? nl : end;
+}
@@ -0,0 +1,47 @@
+/*
+* cmd_parse.h
+*
+* Front end that turns input lines into alarm requests. Lines in the usual
+* shape ("3 Message(2, 1) hi", "Create_Thread: MessageType(2)",
+* "Cancel: Message(1)") are classified from their first bytes and their
+* numbers are converted 8 digits at a time, so that piped input is not limited
+* by sscanf. Anything the fast path does not recognise is handed to the
+* original sscanf formats, which stay the definition of the input language.
+*/
+#ifndef __cmd_parse_h
+#define __cmd_parse_h
+
+#include <stddef.h>
+
+#define MESSAGE_SIZE 128 // size of the message buffer of an alarm
+
+#define CMD_BAD     0 // not a valid command
+#define CMD_TYPE_A  1 // <seconds> Message(<type>, <number>) <message>
+#define CMD_TYPE_B  2 // Create_Thread: MessageType(<type>)
+#define CMD_TYPE_C  3 // Cancel: Message(<number>)
+#define CMD_DEBUG   4 // debug
+#define CMD_STATS   5 // stats
+#define CMD_ADVANCE 6 // advance <seconds>, with the simulated clock
+#define CMD_SET     7 // set [<name> <value>], the rest of the line in message
+
+typedef struct command_tag {
+  int                 kind; // one of the CMD_ values
+  int                 seconds;
+  int                 type;
+  int                 number;
+  char                message[MESSAGE_SIZE];
+} command_t;
+
+/*
+* Parses one line of "len" bytes (without its newline). Returns cmd->kind.
+* The numbers are range checked the same way main always did (> 0).
+*/
+int parse_command(const char *line, size_t len, command_t *cmd);
+
+/*
+* Returns the end of the line starting at "p", that is the address of its
+* newline or "end" if the buffer ends first.
+*/
+const char *find_line_end(const char *p, const char *end);
+
+#endif
@@ -0,0 +1,227 @@
+/*
+* cmd_ring.c
+*
+* Shared memory command ring, see cmd_ring.h.
+*
+* The slot protocol is the bounded queue of D. Vyukov: slot "i" of position
+* "pos" is free for a producer when its seq is pos, full when it is pos + 1,
+* and free again for position pos + slots once a3 has read it. The futexes
+* are not private, since the waiters and wakers are in different processes.
+*
+* a3 and a producer each check the other's flag after publishing their own
+* change (seq_cst on both sides), so one of them always sees the other: a3
+* never sleeps on a command that was just put, and a producer never sleeps
+* on a slot that was just freed.
+*/
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "errors.h"
+#include "cmd_ring.h"
+
+static void futex_wait(uint32_t *word, uint32_t value){
+  syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0); // EAGAIN, EINTR are fine
+}
+
+static void futex_wake(uint32_t *word, int count){
+  syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+/*
+* Wakes the producers waiting for free slots, if there are any. The slot
+* freed last was stored seq_cst, so it is ordered before the load of
+* "blocked" without a fence (which ThreadSanitizer could not follow).
+*/
+static void wake_producers(cmd_ring_t *ring){
+  if (__atomic_load_n(&ring->blocked, __ATOMIC_SEQ_CST) > 0){
+    __atomic_add_fetch(&ring->space, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ring->space, INT_MAX);
+  }
+}
+
+/*
+* The ring is created under a temporary name and then renamed, so that a
+* producer never maps a file that is still being set up, nor the ring of an
+* earlier run that the new one replaces.
+*/
+cmd_reader_t *cmd_ring_create(const char *path, long slots){
+  cmd_reader_t *reader;
+  cmd_ring_t *ring;
+  char temp[4096];
+  uint64_t count = 4, i;
+  size_t size;
+  int fd;
+
+  while (count < (uint64_t)slots)
+    count *= 2;
+  size = sizeof(cmd_ring_t) + count * sizeof(cmd_slot_t);
+  snprintf(temp, sizeof(temp), "%s.%d", path, (int)getpid());
+  fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0 || ftruncate(fd, size) < 0)
+    errno_abort ("Create command ring");
+  ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED)
+    errno_abort ("Map command ring");
+  close(fd);
+
+  ring->slots = count;
+  for (i = 0; i < count; i++)
+    ring->slot[i].seq = i;
+  memcpy(ring->magic, CMD_RING_MAGIC, sizeof(ring->magic));
+  if (rename(temp, path) < 0)
+    errno_abort ("Create command ring");
+
+  reader = (cmd_reader_t*)malloc (sizeof (cmd_reader_t));
+  if (reader == NULL)
+    errno_abort ("Allocate command ring reader");
+  reader->ring = ring;
+  reader->slots = count;
+  reader->mask = count - 1;
+  reader->head = 0;
+  return reader;
+}
+
+/*
+* Frees the slot at "head" for the producers. The shared head is only
+* written, for the producers to see, never read back.
+*/
+static void release_slot(cmd_reader_t *reader){
+  cmd_ring_t *ring = reader->ring;
+  uint64_t head = reader->head++;
+
+  __atomic_store_n(&ring->slot[head & reader->mask].seq, head + reader->slots,
+    __ATOMIC_SEQ_CST);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELAXED);
+
+  /*
+  * blocked producers are woken once a quarter of the ring is free rather
+  * than for every slot, and before a3 sleeps
+  */
+  if ((head + 1) % (reader->slots / 4) == 0)
+    wake_producers(ring);
+}
+
+int cmd_ring_poll(cmd_reader_t *reader, cmd_slot_t *copy){
+  uint64_t head = reader->head;
+  cmd_slot_t *slot = &reader->ring->slot[head & reader->mask];
+  command_t *cmd = &copy->command;
+  int valid;
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1)
+    return 0;
+
+  /*
+  * the producer is not trusted to have filled the slot in properly, nor to
+  * leave it alone once it is full: only a copy is checked and used
+  */
+  memcpy(copy->name, slot->name, sizeof(copy->name));
+  *cmd = slot->command;
+  release_slot(reader);
+  copy->name[CMD_NAME_SIZE - 1] = '\0';
+  cmd->message[MESSAGE_SIZE - 1] = '\0';
+  switch (cmd->kind){
+    case CMD_TYPE_A:
+      valid = cmd->seconds > 0 && cmd->type > 0 && cmd->number > 0;
+      break;
+    case CMD_TYPE_B: valid = cmd->type > 0; break;
+    case CMD_TYPE_C: valid = cmd->number > 0; break;
+    case CMD_DEBUG: case CMD_STATS: case CMD_SET: valid = 1; break;
+    case CMD_ADVANCE: valid = cmd->seconds > 0; break;
+    default: valid = 0;
+  }
+  if (!valid)
+    cmd->kind = CMD_BAD;
+  return 1;
+}
+
+int cmd_ring_wait(cmd_reader_t *reader){
+  cmd_ring_t *ring = reader->ring;
+  uint32_t wake;
+
+  wake_producers(ring);
+  while (1){
+    wake = __atomic_load_n(&ring->wake, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->slot[reader->head & reader->mask].seq,
+      __ATOMIC_SEQ_CST) == reader->head + 1)
+      break;
+    if (__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST)){
+      __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+      return 0;
+    }
+    futex_wait(&ring->wake, wake);
+  }
+  __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+  return 1;
+}
+
+cmd_ring_t *cmd_ring_open(const char *path, int timeout){
+  struct timespec pause = {0, 10000000};
+  struct stat st;
+  cmd_ring_t *ring;
+  int fd, tries;
+
+  for (tries = 0; (fd = open(path, O_RDWR | O_CLOEXEC)) < 0; tries++){
+    if (errno != ENOENT || tries >= timeout * 100)
+      errno_abort ("Open command ring");
+    nanosleep(&pause, NULL); // a3 has not created it yet
+  }
+  if (fstat(fd, &st) < 0)
+    errno_abort ("Open command ring");
+  ring = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED)
+    errno_abort ("Map command ring");
+  close(fd);
+  if ((size_t)st.st_size < sizeof(cmd_ring_t) ||
+    memcmp(ring->magic, CMD_RING_MAGIC, sizeof(ring->magic)) != 0 ||
+    sizeof(cmd_ring_t) + ring->slots * sizeof(cmd_slot_t) > (size_t)st.st_size){
+    fprintf(stderr, "%s: not an a3 command ring\n", path);
+    exit(1);
+  }
+  return ring;
+}
+
+void cmd_ring_put(cmd_ring_t *ring, const char *name, const command_t *cmd){
+  uint64_t pos, seq;
+  uint32_t space;
+  cmd_slot_t *slot;
+
+  pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  while (1){
+    slot = &ring->slot[pos & (ring->slots - 1)];
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos){
+      if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }else if (seq < pos){ // full, a3 has not read this slot's last command
+      space = __atomic_load_n(&ring->space, __ATOMIC_SEQ_CST);
+      __atomic_add_fetch(&ring->blocked, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) < pos)
+        futex_wait(&ring->space, space);
+      __atomic_sub_fetch(&ring->blocked, 1, __ATOMIC_SEQ_CST);
+    }else{ // another producer took the slot
+      pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  memset(slot->name, 0, sizeof(slot->name));
+  if (name != NULL)
+    strncpy(slot->name, name, sizeof(slot->name) - 1);
+  slot->command = *cmd;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST)){
+    __atomic_add_fetch(&ring->wake, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ring->wake, 1);
+  }
+}
+
+void cmd_ring_close(cmd_ring_t *ring){
+  __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&ring->wake, 1, __ATOMIC_SEQ_CST);
+  futex_wake(&ring->wake, 1);
+}
@@ -0,0 +1,83 @@
+/*
+* cmd_ring.h
+*
+* Shared memory command ring, for producers on the same host that would
+* otherwise have to print their requests for a3 to parse them again. The
+* ring is a file (in /dev/shm, usually) mapped by a3 and by any number of
+* producers; each slot holds one command_t, which a3 copies out and hands to
+* its handlers without parsing it.
+*
+* Producers claim slots by moving "tail" forward with a compare and swap and
+* mark a slot full by storing its sequence number; a3 reads the slots in
+* order from "head". Waiting, for a3 on an empty ring and for producers on a
+* full one, is done on futexes in the shared memory, so neither side makes a
+* system call while the other keeps up.
+*/
+#ifndef __cmd_ring_h
+#define __cmd_ring_h
+
+#include <stdint.h>
+#include "cmd_parse.h"
+
+#define CMD_RING_MAGIC "a3cmds1"
+#define CMD_RING_SLOTS 4096 // default number of slots
+#define CMD_NAME_SIZE  32 // size of the namespace name of a slot
+
+typedef struct cmd_slot_tag {
+  uint64_t            seq; // position + 1 once full, position + slots once read
+  char                name[CMD_NAME_SIZE]; // namespace, "" for the default one
+  command_t           command;
+} cmd_slot_t;
+
+typedef struct cmd_ring_tag {
+  char                magic[8];
+  uint64_t            slots; // a power of 2
+  uint32_t            closed; // no more commands will come
+  uint64_t            tail __attribute__((aligned(64))); // next slot to claim
+  uint32_t            blocked; // producers waiting for a free slot
+  uint32_t            space; // futex, bumped when slots are freed
+  uint64_t            head __attribute__((aligned(64))); // next slot a3 reads
+  uint32_t            waiting; // 1 while a3 waits for a command
+  uint32_t            wake; // futex, bumped when a command is put
+  cmd_slot_t          slot[] __attribute__((aligned(64)));
+} cmd_ring_t;
+
+/*
+* a3's own view of the ring. Producers can write anywhere in the mapping, so
+* a3 keeps the size and its read position here and never reads them back
+* from the shared header.
+*/
+typedef struct cmd_reader_tag {
+  cmd_ring_t          *ring;
+  uint64_t            slots; // a power of 2, at least 4
+  uint64_t            mask; // slots - 1
+  uint64_t            head; // next slot to read, copied to ring->head
+} cmd_reader_t;
+
+/*
+* a3's side: creates the ring "path" with "slots" slots (rounded up to a
+* power of 2, at least 4), then takes the commands out of it in order.
+* cmd_ring_poll() copies the next command and its namespace name into
+* "copy" and frees its slot, or returns 0 if there is none yet. The copy is
+* checked the way parse_command() checks a line (a bad one has kind
+* CMD_BAD), so a producer that changes the slot afterwards cannot change
+* what a3 runs.
+* cmd_ring_wait() sleeps until a command comes and returns 0 once the ring
+* is closed and empty.
+*/
+cmd_reader_t *cmd_ring_create(const char *path, long slots);
+int cmd_ring_poll(cmd_reader_t *reader, cmd_slot_t *copy);
+int cmd_ring_wait(cmd_reader_t *reader);
+
+/*
+* Producers' side: cmd_ring_open() maps the ring a3 created, waiting up to
+* "timeout" seconds for it to appear. cmd_ring_put() adds a command for the
+* namespace "name" (NULL for the default one), waiting while the ring is
+* full. cmd_ring_close() tells a3 that the input has ended, as the end of
+* stdin does.
+*/
+cmd_ring_t *cmd_ring_open(const char *path, int timeout);
+void cmd_ring_put(cmd_ring_t *ring, const char *name, const command_t *cmd);
+void cmd_ring_close(cmd_ring_t *ring);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+* due_scan.c
+*
+* Implementations of the due alarm scan. Each vector kernel compares a block of
+* deadlines against "now" at once and only looks at individual alarms when at
+* least one deadline in the block has passed, which is the rare case for a
+* type with many alarms.
+*/
+#include <string.h>
+#include "due_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DUE_SCAN_X86 1
+#endif
+
+typedef size_t (*due_scan_fn)(const int64_t *, size_t, int64_t, uint32_t *);
+
+static due_scan_fn selected_kernel = NULL;
+static const char *selected_name = "scalar";
+
+/*
+* Scalar scan of deadline[start..count), writing absolute indices. Used on its
+* own when there is no vector unit and for the tail of the vector kernels.
+*/
+static size_t scan_tail(const int64_t *deadline, size_t start, size_t count,
+  int64_t now, uint32_t *due){
+  size_t i, n = 0;
+
+  for (i = start; i < count; i++){
+    due[n] = (uint32_t)i;
+    n += (deadline[i] <= now); // branch free compaction
+  }
+  return n;
+}
+
+size_t due_scan_scalar(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due){
+  return scan_tail(deadline, 0, count, now, due);
+}
+
+#ifdef DUE_SCAN_X86
+/*
+* 2 deadlines per compare. pcmpgtq is the first 64 bit compare, which is why
+* this needs SSE4.2 rather than SSE2.
+*/
+__attribute__((target("sse4.2")))
+size_t due_scan_sse42(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due){
+  size_t i = 0, n = 0;
+  __m128i vnow = _mm_set1_epi64x(now);
+  int mask;
+
+  for (; i + 2 <= count; i += 2){
+    __m128i d = _mm_loadu_si128((const __m128i *)(deadline + i));
+
+    // a lane is NOT due when deadline > now
+    mask = ~_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(d, vnow))) & 0x3;
+    while (mask != 0){
+      due[n++] = (uint32_t)(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return n + scan_tail(deadline, i, count, now, due + n);
+}
+
+/*
+* 8 deadlines per iteration (two 4 lane compares), which lets the common case
+* of "nothing is due" skip through the array with a single test per 8 alarms.
+*/
+__attribute__((target("avx2")))
+size_t due_scan_avx2(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due){
+  size_t i = 0, n = 0;
+  __m256i vnow = _mm256_set1_epi64x(now);
+  int mask;
+
+  for (; i + 8 <= count; i += 8){
+    __m256i lo = _mm256_loadu_si256((const __m256i *)(deadline + i));
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(deadline + i + 4));
+
+    mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(lo, vnow)))
+      | (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(hi, vnow)))
+      << 4);
+    mask = ~mask & 0xff;
+    while (mask != 0){
+      due[n++] = (uint32_t)(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return n + scan_tail(deadline, i, count, now, due + n);
+}
+#else
+size_t due_scan_sse42(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due){
+  return scan_tail(deadline, 0, count, now, due);
+}
+
+size_t due_scan_avx2(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due){
+  return scan_tail(deadline, 0, count, now, due);
+}
+#endif
+
+/*
+* returns 1 if the named kernel can run on this CPU and 0 otherwise
+*/
+int due_scan_kernel_supported(const char *name){
+  if (strcmp(name, "scalar") == 0)
+    return 1;
+#ifdef DUE_SCAN_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse4.2") == 0)
+    return __builtin_cpu_supports("sse4.2");
+  if (strcmp(name, "avx2") == 0)
+    return __builtin_cpu_supports("avx2");
+#endif
+  return 0;
+}
+
+/*
+* Picks the kernel once. Every thread that races here picks the same one, so
+* no locking is needed.
+*/
+static void select_kernel(){
+  due_scan_fn fn = due_scan_scalar;
+  const char *name = "scalar";
+
+  if (due_scan_kernel_supported("avx2")){
+    fn = due_scan_avx2;
+    name = "avx2";
+  }else if (due_scan_kernel_supported("sse4.2")){
+    fn = due_scan_sse42;
+    name = "sse4.2";
+  }
+  __atomic_store_n(&selected_name, name, __ATOMIC_RELAXED);
+  __atomic_store_n(&selected_kernel, fn, __ATOMIC_RELEASE);
+}
+
+size_t due_scan(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due){
+  due_scan_fn fn = __atomic_load_n(&selected_kernel, __ATOMIC_ACQUIRE);
+
+  if (fn == NULL){
+    select_kernel();
+    fn = __atomic_load_n(&selected_kernel, __ATOMIC_ACQUIRE);
+  }
+  return fn(deadline, count, now, due);
+}
+
+const char *due_scan_kernel_name(){
+  if (__atomic_load_n(&selected_kernel, __ATOMIC_ACQUIRE) == NULL)
+    select_kernel();
+  return __atomic_load_n(&selected_name, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,40 @@
+/*
+* due_scan.h
+*
+* Scan kernel used by the periodic display threads to find which alarms of a
+* message type are due. Deadlines of a type are kept in one contiguous array
+* so that "now >= deadline" can be checked for several alarms per instruction.
+*
+* due_scan() picks the widest implementation the CPU supports the first time
+* it is called (AVX2, then SSE4.2, then plain C).
+*/
+#ifndef __due_scan_h
+#define __due_scan_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Writes the index of every deadline <= now into "due" (in increasing order)
+* and returns how many were written. "due" must have room for "count" entries.
+*/
+size_t due_scan(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due);
+
+/*
+* The individual kernels, exposed so that the benchmark can compare them.
+* due_scan_sse42() and due_scan_avx2() must only be called when
+* due_scan_kernel_supported() says so (they fall back to plain C on non x86
+* builds).
+*/
+size_t due_scan_scalar(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due);
+size_t due_scan_sse42(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due);
+size_t due_scan_avx2(const int64_t *deadline, size_t count, int64_t now,
+  uint32_t *due);
+
+int due_scan_kernel_supported(const char *name); // "scalar", "sse4.2", "avx2"
+const char *due_scan_kernel_name(); // kernel selected by due_scan()
+
+#endif
@@ -0,0 +1,80 @@
+/*
+* fmt.c
+*
+* Integer, time and string formatters, see fmt.h.
+*/
+#include <stdint.h>
+#include "fmt.h"
+
+static const char digit_pairs[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536"
+  "37383940414243444546474849505152535455565758596061626364656667686970717273"
+  "7475767778798081828384858687888990919293949596979899";
+
+static const uint64_t powers_of_10[20] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+  1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+  1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/*
+* returns the number of decimal digits of "value": log10 from log2 (1233 /
+* 4096 is just over log10(2)), corrected by one comparison
+*/
+static int digit_count(uint64_t value){
+  int log2 = 63 - __builtin_clzll(value | 1);
+  int log10 = (log2 + 1) * 1233 >> 12;
+
+  return log10 - (value < powers_of_10[log10]) + 1 + (value == 0);
+}
+
+char *fmt_uint(char *p, unsigned long value){
+  int count = digit_count(value);
+  char *end = p + count;
+  unsigned int pair;
+
+  while (value >= 100){
+    pair = (value % 100) * 2;
+    value /= 100;
+    end -= 2;
+    end[0] = digit_pairs[pair];
+    end[1] = digit_pairs[pair + 1];
+  }
+  if (value >= 10){
+    end[-2] = digit_pairs[value * 2];
+    end[-1] = digit_pairs[value * 2 + 1];
+  }else{
+    end[-1] = '0' + value;
+  }
+  return p + count;
+}
+
+char *fmt_int(char *p, long value){
+  if (value < 0){
+    *p++ = '-';
+    return fmt_uint(p, -(unsigned long)value);
+  }
+  return fmt_uint(p, value);
+}
+
+char *fmt_time(char *p, time_t time){
+  static __thread time_t cached_time;
+  static __thread char cached[FMT_INT_SIZE];
+  static __thread int cached_len;
+
+  if (cached_len == 0 || time != cached_time){
+    cached_len = fmt_int(cached, time) - cached;
+    cached_time = time;
+  }
+  memcpy(p, cached, cached_len);
+  return p + cached_len;
+}
+
+char *fmt_string(char *p, const char *s, size_t max){
+  size_t len = strnlen(s, max);
+
+  memcpy(p, s, len);
+  return p + len;
+}
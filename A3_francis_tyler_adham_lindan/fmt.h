@@ -0,0 +1,36 @@
+/*
+* fmt.h
+*
+* Formatters for the output lines written most often (alarms displayed, Type
+* A requests received), used instead of printf. Each one writes at "p" and
+* returns the end of what it wrote; nothing is terminated with '\0'. The
+* caller makes sure the buffer is large enough (FMT_INT_SIZE for a number).
+*
+* Numbers are written two digits at a time from a table of the 100 digit
+* pairs, after counting the digits without a loop. The same time is usually
+* formatted for many lines in a row (every alarm due in one second), so
+* fmt_time() keeps the digits of the last time it formatted in each thread.
+*/
+#ifndef __fmt_h
+#define __fmt_h
+
+#include <string.h>
+#include <time.h>
+
+#define FMT_INT_SIZE 20 // characters of the longest long
+
+/*
+* copies a string literal
+*/
+#define fmt_literal(p, s) ((char *)memcpy((p), (s), sizeof(s) - 1) + sizeof(s) - 1)
+
+char *fmt_uint(char *p, unsigned long value);
+char *fmt_int(char *p, long value);
+char *fmt_time(char *p, time_t time);
+
+/*
+* copies "s", at most "max" characters of it
+*/
+char *fmt_string(char *p, const char *s, size_t max);
+
+#endif
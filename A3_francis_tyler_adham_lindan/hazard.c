@@ -0,0 +1,133 @@
+/*
+* hazard.c
+*
+* Hazard pointer records and the retired node list, see hazard.h.
+*
+* The retired list is scanned once it holds HAZARD_BATCH nodes more than
+* there were published pointers at the last scan, so that every scan frees
+* at least a batch of nodes and the cost of a scan is spread over them.
+*/
+#include <stdlib.h>
+#include "errors.h"
+#include "hazard.h"
+
+#define HAZARD_BATCH 64
+
+typedef struct retired_tag {
+  void                *node;
+  void                (*reclaim)(void *);
+} retired_t;
+
+static hazard_t *records = NULL;
+static retired_t *retired = NULL;
+static long retired_count = 0, retired_size = 0;
+static long scan_at = HAZARD_BATCH; // retired_count that triggers a scan
+
+hazard_t *hazard_acquire(){
+  hazard_t *record, *head;
+
+  for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record != NULL;
+    record = record->link)
+    if (__atomic_exchange_n(&record->active, 1, __ATOMIC_ACQ_REL) == 0)
+      return record;
+
+  record = (hazard_t*)calloc (1, sizeof (hazard_t));
+  if (record == NULL)
+    errno_abort ("Allocate hazard record");
+  record->size = 16; // hazard_set() never has to grow the array
+  record->pointer = malloc(record->size * sizeof(void *));
+  if (record->pointer == NULL)
+    errno_abort ("Allocate hazard pointers");
+  record->active = 1;
+  head = __atomic_load_n(&records, __ATOMIC_RELAXED);
+  do
+    record->link = head;
+  while (!__atomic_compare_exchange_n(&records, &head, record, 0,
+    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  return record;
+}
+
+void hazard_release(hazard_t *record){
+  hazard_clear(record);
+  __atomic_store_n(&record->active, 0, __ATOMIC_RELEASE);
+}
+
+void hazard_protect(hazard_t *record, void *node){
+  if (record->count == record->size){
+    record->size *= 2;
+    record->pointer = realloc(record->pointer, record->size * sizeof(void *));
+    if (record->pointer == NULL)
+      errno_abort ("Allocate hazard pointers");
+  }
+  __atomic_store_n(&record->pointer[record->count], node, __ATOMIC_RELAXED);
+  __atomic_store_n(&record->count, record->count + 1, __ATOMIC_SEQ_CST);
+}
+
+void hazard_set(hazard_t *record, void *node){
+  __atomic_store_n(&record->pointer[0], node, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&record->count, 1, __ATOMIC_SEQ_CST);
+}
+
+void hazard_clear(hazard_t *record){
+  __atomic_store_n(&record->count, 0, __ATOMIC_SEQ_CST);
+}
+
+static int compare_pointers(const void *a, const void *b){
+  void *x = *(void *const *)a, *y = *(void *const *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/*
+* Frees every retired node that no record publishes, keeping the others.
+*/
+static void scan(){
+  hazard_t *record;
+  void **hazards = NULL;
+  long hazard_count = 0, hazard_size = 0, i, kept = 0;
+  int j, count;
+
+  for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record != NULL;
+    record = record->link){
+    count = __atomic_load_n(&record->count, __ATOMIC_SEQ_CST);
+    if (hazard_count + count > hazard_size){
+      hazard_size = (hazard_count + count) * 2;
+      hazards = realloc(hazards, hazard_size * sizeof(void *));
+      if (hazards == NULL)
+        errno_abort ("Allocate hazard scan");
+    }
+    for (j = 0; j < count; j++)
+      hazards[hazard_count++] =
+        __atomic_load_n(&record->pointer[j], __ATOMIC_SEQ_CST);
+  }
+  if (hazard_count > 0)
+    qsort(hazards, hazard_count, sizeof(void *), compare_pointers);
+
+  for (i = 0; i < retired_count; i++){
+    if (hazard_count > 0 && bsearch(&retired[i].node, hazards, hazard_count,
+      sizeof(void *), compare_pointers) != NULL)
+      retired[kept++] = retired[i]; // still in use
+    else
+      retired[i].reclaim(retired[i].node);
+  }
+  retired_count = kept;
+  scan_at = kept + hazard_count + HAZARD_BATCH;
+  free(hazards);
+}
+
+void hazard_retire(void *node, void (*reclaim)(void *)){
+  if (retired_count == retired_size){
+    retired_size = retired_size == 0 ? 2 * HAZARD_BATCH : retired_size * 2;
+    retired = realloc(retired, retired_size * sizeof(retired_t));
+    if (retired == NULL)
+      errno_abort ("Allocate retired list");
+  }
+  retired[retired_count].node = node;
+  retired[retired_count].reclaim = reclaim;
+  if (++retired_count >= scan_at)
+    scan();
+}
+
+long hazard_retired(){
+  return retired_count;
+}
@@ -0,0 +1,56 @@
+/*
+* hazard.h
+*
+* Hazard pointers for memory that is read outside the read lock of the alarm
+* lists (alarm nodes being printed, Type B registries). A thread that wants
+* to keep using nodes after it has left the read lock publishes them in its
+* hazard record first; a writer that takes a node out of the lists retires
+* it instead of freeing it, and retired nodes are only freed once no record
+* holds them.
+*
+* Records are never freed, a thread that is done with its record releases it
+* and the next thread that asks for one reuses it.
+*/
+#ifndef __hazard_h
+#define __hazard_h
+
+typedef struct hazard_tag {
+  struct hazard_tag   *link;
+  int                 active; // 1 while a thread owns the record
+  int                 count; // number of pointers published
+  int                 size; // allocated pointers
+  void                **pointer;
+} hazard_t;
+
+hazard_t *hazard_acquire();
+void hazard_release(hazard_t *record);
+
+/*
+* Publishes "node". The caller must know that "node" has not been retired
+* yet, which is the case while it holds the read lock of the alarm lists.
+* The record's array is only grown there as well, where no writer can be
+* scanning it.
+*/
+void hazard_protect(hazard_t *record, void *node);
+
+/*
+* Publishes "node" as the only pointer of the record, without any lock. The
+* caller then checks that "node" is still reachable where it was loaded
+* from; if so, it is protected until the next hazard_set() or hazard_clear().
+*/
+void hazard_set(hazard_t *record, void *node);
+
+/*
+* Withdraws every pointer the record publishes. Can be called without a lock.
+*/
+void hazard_clear(hazard_t *record);
+
+/*
+* Frees "node" with "reclaim" once no record publishes it. Called by writers
+* of the alarm lists only, which is what serialises the retired list.
+*/
+void hazard_retire(void *node, void (*reclaim)(void *));
+
+long hazard_retired(); // nodes retired but not yet freed
+
+#endif
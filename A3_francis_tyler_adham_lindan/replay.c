@@ -0,0 +1,111 @@
+/*
+* replay.c
+*
+* Replays a file recorded with "a3 -R file" by writing its lines to stdout at
+* the times they were recorded, so that a recorded session can be run again:
+*
+*     ./replay trace.log | ./a3 > run.out
+*
+* -s speed   replay "speed" times faster than recorded (default 1, original
+*            pace). 0 writes the lines as fast as possible.
+* -l seconds keep stdout open that long after the last line, so that a3 keeps
+*            running and its alarms keep firing (a3 exits at end of input).
+*
+* At the end, the number of lines and how late the latest line was written
+* compared to its schedule are reported on stderr.
+*/
+#include <time.h>
+#include "errors.h"
+
+/*
+* returns the timespec "sec" seconds after "base"
+*/
+static struct timespec add_seconds(struct timespec base, double sec){
+  long nsec = (long)((sec - (long)sec) * 1e9);
+
+  base.tv_sec += (long)sec;
+  base.tv_nsec += nsec;
+  if (base.tv_nsec >= 1000000000L){
+    base.tv_sec++;
+    base.tv_nsec -= 1000000000L;
+  }
+  return base;
+}
+
+/*
+* sleeps until "due" on the monotonic clock
+*/
+static void sleep_until(struct timespec due){
+  int status;
+
+  while ((status = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL)) != 0)
+    if (status != EINTR) // interrupted by a signal, sleep again
+      err_abort(status, "Sleep");
+}
+
+/*
+* returns a - b in seconds
+*/
+static double diff_seconds(struct timespec a, struct timespec b){
+  return (a.tv_sec - b.tv_sec) + (a.tv_nsec - b.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]){
+  FILE *in;
+  char *line = NULL, *text;
+  size_t line_size = 0;
+  double speed = 1, linger = 0, stamp, late, max_late = 0;
+  long lines = 0;
+  struct timespec start, due, now;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:l:")) != -1){
+    switch (opt){
+      case 's': speed = atof(optarg); break;
+      case 'l': linger = atof(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-s speed] [-l linger_seconds] record_file\n",
+          argv[0]);
+        exit(1);
+    }
+  }
+  if (optind != argc - 1 || speed < 0 || linger < 0){
+    fprintf(stderr, "usage: %s [-s speed] [-l linger_seconds] record_file\n",
+      argv[0]);
+    exit(1);
+  }
+  if ((in = fopen(argv[optind], "r")) == NULL)
+    errno_abort("Open record file");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (getline(&line, &line_size, in) != -1){ // any length, as a3 -R wrote it
+    stamp = strtod(line, &text);
+    if (text == line || *text != ' ' || !(stamp >= 0)){
+      fprintf(stderr, "replay: skipping malformed line %ld\n", lines + 1);
+      continue;
+    }
+    text++;
+
+    if (speed > 0){
+      due = add_seconds(start, stamp / speed);
+      fflush(stdout); // everything up to now is out before sleeping
+      sleep_until(due);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      late = diff_seconds(now, due);
+      if (late > max_late)
+        max_late = late;
+    }
+    fputs(text, stdout);
+    lines++;
+  }
+  fflush(stdout);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fprintf(stderr, "replay: %ld lines in %.3f s, latest line %.3f ms late\n",
+    lines, diff_seconds(now, start), max_late * 1e3);
+
+  if (linger > 0)
+    sleep_until(add_seconds(now, linger));
+  free(line);
+  return 0;
+}
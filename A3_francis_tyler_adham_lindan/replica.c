@@ -0,0 +1,199 @@
+/*
+* replica.c
+*
+* Hot standby replication over a Unix domain stream socket, see replica.h.
+*
+* The monotonic clock is the same for every process of the host, so the
+* standby can take the primary's stamps as they are to measure the lag.
+* Writes to the standby block: a standby that cannot keep up slows the
+* primary down rather than missing lines. Standbys are accepted by a thread
+* of their own, so that one is brought up to date even while main waits for
+* input.
+*/
+#define _GNU_SOURCE // accept4
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "errors.h"
+#include "replica.h"
+
+int replica_on = 0;
+
+static int listen_fd = -1;
+static sem_t replica_sem; // held by main for a request, by accept_thread for a state
+static void (*send_state)();
+static int standby_fd = -1;
+static char send_buffer[REPLICA_BLOCK];
+static size_t send_len = 0;
+static long sent = 0;
+
+static long lag_lines = 0;
+static double lag_total = 0, lag_max = 0; // microseconds
+
+static void socket_address(struct sockaddr_un *address, const char *path){
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)){
+    fprintf(stderr, "Replication socket path too long: %s\n", path);
+    exit(1);
+  }
+  strcpy(address->sun_path, path);
+}
+
+/*
+* Accepts standbys, one after the other, for as long as the program runs.
+*/
+static void *accept_thread(void *arg){
+  int fd;
+
+  while (1){
+    if ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) < 0){
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      errno_abort ("Accept standby");
+    }
+    replica_lock();
+    if (standby_fd >= 0)
+      close(standby_fd); // the newest standby wins
+    standby_fd = fd;
+    send_len = 0;
+    replica_on = 1;
+    send_state();
+    replica_flush();
+    replica_unlock();
+  }
+  return NULL;
+}
+
+void replica_listen(const char *path, void (*state)()){
+  struct sockaddr_un address;
+  pthread_t thread;
+  int status;
+
+  socket_address(&address, path);
+  unlink(path);
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address,
+    sizeof(address)) < 0 || listen(listen_fd, 1) < 0)
+    errno_abort ("Listen for standby");
+  send_state = state;
+  if (sem_init(&replica_sem, 0, 1) != 0)
+    errno_abort ("Create Replication Semaphore");
+  status = pthread_create(&thread, NULL, accept_thread, NULL);
+  if (status != 0)
+    err_abort (status, "Create accept thread");
+  pthread_detach(thread);
+}
+
+void replica_lock(){
+  if (listen_fd < 0)
+    return;
+  while (sem_wait(&replica_sem) != 0){
+    // interrupted by a signal, wait again
+  }
+}
+
+void replica_unlock(){
+  if (listen_fd >= 0)
+    sem_post(&replica_sem);
+}
+
+/*
+* Closes the standby after a failed write.
+*/
+static void drop_standby(){
+  fprintf(stderr, "Standby lost: %s\n", strerror(errno));
+  close(standby_fd);
+  standby_fd = -1;
+  replica_on = 0;
+  send_len = 0;
+}
+
+void replica_flush(){
+  size_t done = 0;
+  ssize_t n;
+
+  while (replica_on && done < send_len){
+    n = send(standby_fd, send_buffer + done, send_len - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0){
+      drop_standby();
+      return;
+    }
+    done += n;
+  }
+  send_len = 0;
+}
+
+void replica_send(const char *line, size_t len){
+  struct timespec now;
+  int stamp;
+
+  if (!replica_on)
+    return;
+  if (len > REPLICA_BLOCK - 64)
+    len = REPLICA_BLOCK - 64; // longer than any line main handles
+  if (send_len + len + 64 > REPLICA_BLOCK)
+    replica_flush();
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  stamp = snprintf(send_buffer + send_len, 64, "%ld.%09ld ", (long)now.tv_sec,
+    now.tv_nsec);
+  memcpy(send_buffer + send_len + stamp, line, len);
+  send_len += stamp + len;
+  send_buffer[send_len++] = '\n';
+  sent++;
+}
+
+long replica_sent(){
+  return sent;
+}
+
+int replica_follow(const char *path, int timeout){
+  struct sockaddr_un address;
+  int fd, tries;
+
+  socket_address(&address, path);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    errno_abort ("Connect to primary");
+  for (tries = 0; connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0;
+    tries++){
+    if ((errno != ENOENT && errno != ECONNREFUSED) || tries >= timeout * 100)
+      errno_abort ("Connect to primary");
+    usleep(10000);
+  }
+  return fd;
+}
+
+const char *replica_line(const char *line, size_t *len){
+  struct timespec now;
+  const char *end = line + *len, *p;
+  long sec = 0, nsec = 0, digits;
+  double lag;
+
+  for (p = line; p < end && *p >= '0' && *p <= '9'; p++)
+    sec = sec * 10 + (*p - '0');
+  if (p == line || p == end || *p++ != '.')
+    return NULL;
+  for (digits = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+    nsec = nsec * 10 + (*p - '0');
+  if (digits != 9 || p == end || *p++ != ' ')
+    return NULL;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  lag = (now.tv_sec - sec) * 1e6 + (now.tv_nsec - nsec) / 1e3;
+  lag_lines++;
+  lag_total += lag;
+  if (lag > lag_max)
+    lag_max = lag;
+  *len = end - p;
+  return p;
+}
+
+void replica_lag(replica_lag_t *lag){
+  lag->lines = lag_lines;
+  lag->average = lag_lines > 0 ? lag_total / lag_lines : 0;
+  lag->max = lag_max;
+}
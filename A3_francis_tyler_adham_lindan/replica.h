@@ -0,0 +1,68 @@
+/*
+* replica.h
+*
+* Hot standby replication. The primary (a3 -P path) listens on a local
+* socket and sends every input line it accepts to the standby connected
+* there, stamped with the monotonic clock:
+*
+*     <seconds>.<nanoseconds> <line>
+*
+* The standby (a3 -Y path) handles those lines as if they were its own input,
+* with its output muted, so its alarms, display threads and deadlines follow
+* the primary's. When the stream ends because the primary is gone, the
+* standby unmutes its output and goes on with its own stdin.
+*
+* Lines are sent before they are handled, in the order main reads them, and
+* are buffered until replica_flush(), which main calls where it flushes its
+* output. A standby that connects late is first sent the primary's state as
+* input lines. A standby that goes away is dropped and the primary goes on alone.
+*/
+#ifndef __replica_h
+#define __replica_h
+
+#include <stddef.h>
+#include <time.h>
+
+#define REPLICA_BLOCK 65536 // bytes of lines sent or read at a time
+
+extern int replica_on; // a standby is connected, see replica_send()
+
+/*
+* Primary's side: replica_listen() makes the socket "path" (replacing an
+* old one) and starts a thread that accepts standbys. A new standby replaces
+* the old one; it is sent the current state by "send_state" (with
+* replica_send()) and then every line main sends after it. Main holds
+* replica_lock() while it handles input and sends its lines, so that the
+* state is never sent in the middle of a request. Without replica_listen(),
+* replica_lock() does nothing.
+*/
+void replica_listen(const char *path, void (*send_state)());
+void replica_lock();
+void replica_unlock();
+void replica_send(const char *line, size_t len);
+void replica_flush();
+long replica_sent(); // lines sent to standbys so far
+
+/*
+* Standby's side: replica_follow() connects to the primary's socket "path",
+* waiting up to "timeout" seconds for it to appear, and returns the socket.
+* replica_line() takes a received line of "*len" bytes, records how long it
+* took from the primary, and returns the line without its stamp (NULL, and
+* nothing recorded, if it has none).
+*/
+int replica_follow(const char *path, int timeout);
+const char *replica_line(const char *line, size_t *len);
+
+/*
+* Lag of the received lines, from their stamp to replica_line(), in
+* microseconds.
+*/
+typedef struct replica_lag_tag {
+  long                lines;
+  double              average;
+  double              max;
+} replica_lag_t;
+
+void replica_lag(replica_lag_t *lag);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+* ring_cat.c
+*
+* Follows the output ring buffer of "a3 -o ring:path" and writes the output
+* to stdout as it arrives:
+*
+*     ./a3 -o ring:/dev/shm/a3.ring < requests &
+*     ./ring_cat /dev/shm/a3.ring
+*
+* The ring is read straight from shared memory; while there is output, no
+* system call is made other than the writes to stdout. When there is none,
+* the ring is looked at again every millisecond.
+*
+* -a  start with everything the ring still holds (default: new output only)
+* -n  exit once no new output has come for a second
+*
+* Output that a3 overwrote before it could be read is skipped and reported
+* on stderr.
+*/
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "errors.h"
+#include "alarm_io.h"
+
+int main(int argc, char *argv[]){
+  out_ring_t *ring;
+  struct stat st;
+  struct timespec idle = {0, 1000000};
+  static char copy[1 << 16];
+  uint64_t tail, head, reserve, size, at, len, part, magic = 0;
+  long idle_ms = 0, lost = 0;
+  int fd, opt, all = 0, stop = 0;
+
+  while ((opt = getopt(argc, argv, "an")) != -1){
+    switch (opt){
+      case 'a': all = 1; break;
+      case 'n': stop = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-a] [-n] ring_file\n", argv[0]);
+        exit(1);
+    }
+  }
+  if (optind != argc - 1){
+    fprintf(stderr, "usage: %s [-a] [-n] ring_file\n", argv[0]);
+    exit(1);
+  }
+
+  if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+    errno_abort ("Open ring");
+  ring = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED)
+    errno_abort ("Map ring");
+  if ((size_t)st.st_size >= sizeof(out_ring_t))
+    magic = __atomic_load_n((uint64_t *)ring->magic, __ATOMIC_ACQUIRE); // size is set before it
+  size = ring->size;
+  if ((size_t)st.st_size < sizeof(out_ring_t) ||
+    memcmp(&magic, RING_MAGIC, sizeof(magic)) != 0 ||
+    size == 0 || (size & (size - 1)) != 0 || // positions wrap with size - 1
+    size > (size_t)st.st_size - sizeof(out_ring_t)){
+    fprintf(stderr, "%s: not an a3 ring\n", argv[optind]);
+    exit(1);
+  }
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  tail = !all ? head : head > size ? head - size : 0;
+
+  while (1){
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail){
+      if (stop && ++idle_ms >= 1000)
+        break;
+      nanosleep(&idle, NULL);
+      continue;
+    }
+    idle_ms = 0;
+    if (head - tail > size){ // overwritten before it was read
+      lost += head - size - tail;
+      tail = head - size;
+    }
+
+    len = head - tail < sizeof(copy) ? head - tail : sizeof(copy);
+    at = tail & (size - 1);
+    part = len < size - at ? len : size - at;
+    memcpy(copy, ring->data + at, part);
+    memcpy(copy + part, ring->data, len - part);
+
+    /*
+    * the copy is good unless a3 has started to write over its start
+    * meanwhile, which it announces in "reserve" before it does
+    */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    reserve = __atomic_load_n(&ring->reserve, __ATOMIC_ACQUIRE);
+    if (reserve - tail > size){
+      lost += reserve - size - tail;
+      tail = reserve - size;
+      continue;
+    }
+    if (fwrite(copy, 1, len, stdout) != len)
+      errno_abort ("Write output");
+    fflush(stdout);
+    tail += len;
+  }
+  if (lost > 0)
+    fprintf(stderr, "ring_cat: %ld bytes overwritten before they were read\n",
+      lost);
+  return 0;
+}
@@ -0,0 +1,158 @@
+/*
+* stress.c
+*
+* Writes a random but repeatable mix of Type A, B and C requests to stdout,
+* for stress runs of a3 (usually one of its sanitizer builds, see
+* "make stress-test"):
+*
+*     ./stress -n 100000 -s 7 | ./a3-tsan > /dev/null
+*
+* -n lines    number of requests (default 100000)
+* -s seed     seed of the random mix, the same seed gives the same requests
+* -t types    message types used (default 16)
+* -k numbers  message numbers used (default 1000), so replacements and
+*             cancellations hit existing alarms
+* -a every    write "advance <1..5>" every "every" requests, for a3 -S
+* -l seconds  keep stdout open that long at the end, so that a3 keeps its
+*             display threads running before it exits
+* -r ring     put the requests in the shared memory command ring of
+*             "a3 -i ring" instead of writing them to stdout, and close the
+*             ring at the end:
+*
+*                 ./a3 -i /dev/shm/a3.cmds > out & ./stress -r /dev/shm/a3.cmds
+*
+* Since a3 reads its input through a pipe (or the ring), the rate at which
+* the requests are written is the rate at which a3 takes them in. It is
+* reported on stderr.
+*/
+#include <time.h>
+#include "errors.h"
+#include "cmd_ring.h"
+
+static cmd_ring_t *ring = NULL; // -r
+
+/*
+* returns the next number of the generator (xorshift32)
+*/
+static unsigned int next_random(unsigned int *state){
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/*
+* writes a request to stdout as a line, or puts it in the command ring
+*/
+static void emit(command_t *cmd){
+  if (ring != NULL){
+    cmd_ring_put(ring, NULL, cmd);
+    return;
+  }
+  switch (cmd->kind){
+    case CMD_TYPE_A:
+      printf("%d Message(%d, %d) %s\n", cmd->seconds, cmd->type, cmd->number,
+        cmd->message);
+      break;
+    case CMD_TYPE_B: printf("Create_Thread: MessageType(%d)\n", cmd->type); break;
+    case CMD_TYPE_C: printf("Cancel: Message(%d)\n", cmd->number); break;
+    case CMD_STATS: printf("stats\n"); break;
+    case CMD_ADVANCE: printf("advance %d\n", cmd->seconds); break;
+  }
+}
+
+/*
+* a Type A request, made from the arguments in the order printf used to take
+* them so that a seed still gives the same requests
+*/
+static void emit_type_a(unsigned int seconds, unsigned int type,
+  unsigned int number, long i){
+  command_t cmd = { .kind = CMD_TYPE_A, .seconds = seconds, .type = type,
+    .number = number };
+
+  snprintf(cmd.message, sizeof(cmd.message), "stress %ld", i);
+  emit(&cmd);
+}
+
+int main(int argc, char *argv[]){
+  long lines = 100000, i, count[4] = { 0, 0, 0, 0 };
+  unsigned int seed = 1, types = 16, numbers = 1000, every = 0, r;
+  double linger = 0, elapsed;
+  struct timespec start, end;
+  command_t cmd = { 0 };
+  int opt, status;
+
+  while ((opt = getopt(argc, argv, "n:s:t:k:a:l:r:")) != -1){
+    switch (opt){
+      case 'n': lines = atol(optarg); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 't': types = strtoul(optarg, NULL, 10); break;
+      case 'k': numbers = strtoul(optarg, NULL, 10); break;
+      case 'a': every = strtoul(optarg, NULL, 10); break;
+      case 'l': linger = atof(optarg); break;
+      case 'r': ring = cmd_ring_open(optarg, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-n lines] [-s seed] [-t types] [-k numbers]"
+          " [-a advance_every] [-l linger_seconds] [-r command_ring]\n", argv[0]);
+        exit(1);
+    }
+  }
+  if (lines < 0 || types == 0 || numbers == 0 || linger < 0){
+    fprintf(stderr, "%s: the counts must be positive\n", argv[0]);
+    exit(1);
+  }
+  if (seed == 0)
+    seed = 1; // xorshift never leaves 0
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < lines; i++){
+    r = next_random(&seed) % 100;
+    if (r < 80){ // mostly new alarms and replacements
+      emit_type_a(next_random(&seed) % 5 + 1, next_random(&seed) % types + 1,
+        next_random(&seed) % numbers + 1, i);
+      count[1]++;
+    }else if (r < 90){
+      cmd.kind = CMD_TYPE_B;
+      cmd.type = next_random(&seed) % types + 1;
+      emit(&cmd);
+      count[2]++;
+    }else if (r < 99){
+      cmd.kind = CMD_TYPE_C;
+      cmd.number = next_random(&seed) % numbers + 1;
+      emit(&cmd);
+      count[3]++;
+    }else{
+      cmd.kind = CMD_STATS;
+      emit(&cmd);
+    }
+    if (every > 0 && i % every == every - 1){
+      cmd.kind = CMD_ADVANCE;
+      cmd.seconds = next_random(&seed) % 5 + 1;
+      emit(&cmd);
+    }
+  }
+  fflush(stdout);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "stress: %ld requests (A %ld, B %ld, C %ld) taken in %.3f s,"
+    " %.0f requests/s\n", lines, count[1], count[2], count[3], elapsed,
+    elapsed > 0 ? lines / elapsed : 0);
+
+  if (linger > 0){
+    end.tv_sec += (long)linger;
+    end.tv_nsec += (long)((linger - (long)linger) * 1e9);
+    if (end.tv_nsec >= 1000000000L){
+      end.tv_sec++;
+      end.tv_nsec -= 1000000000L;
+    }
+    while ((status = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL)) != 0)
+      if (status != EINTR) // interrupted by a signal, sleep again
+        err_abort(status, "Sleep");
+  }
+  if (ring != NULL)
+    cmd_ring_close(ring);
+  return 0;
+}